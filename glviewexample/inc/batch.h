@@ -0,0 +1,106 @@
+/*
+ * batch.h
+ *
+ * Geometry batching for many small meshes.
+ *
+ * Meshes are sorted into buckets by material (program + blend mode). Each
+ * material has a static bucket, merged once into a single interleaved VBO
+ * and a 32-bit IBO, and a dynamic bucket that is refilled on the CPU every
+ * frame and streamed into an orphaned buffer. Drawing a batch costs one
+ * glDrawElements per non-empty bucket, however many meshes it holds, so
+ * thousands of UI primitives no longer mean thousands of draws.
+ *
+ * Vertices are merged as they are, so mesh transforms must be applied
+ * before a mesh is added.
+ */
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <Elementary.h>
+
+#define BATCH_MAX_MATERIALS 8
+
+/*
+ * Interleaved vertex, 16 bytes: attribute 0 position, attribute 1 color
+ */
+typedef struct {
+	GLfloat position[3];
+	GLubyte color[4];
+} batch_vertex_s;
+
+typedef enum {
+	BATCH_BLEND_NONE,
+	BATCH_BLEND_ALPHA,
+} batch_blend_e;
+
+typedef struct {
+	batch_vertex_s *vertices;
+	GLuint *indices;
+	int vertex_count, vertex_capacity;
+	int index_count, index_capacity;
+	int mesh_count;
+	GLuint vbo, ibo;
+	GLsizeiptr vbo_size, ibo_size;	/* size of the GL buffers */
+	Eina_Bool dirty;		/* CPU arrays changed since the last upload */
+} batch_bucket_s;
+
+typedef struct {
+	GLuint program;
+	batch_blend_e blend;
+	batch_bucket_s static_bucket;
+	batch_bucket_s dynamic_bucket;
+} batch_material_s;
+
+typedef struct {
+	int draws;
+	int meshes;
+	int vertices;
+	int uploads;
+} batch_stats_s;
+
+typedef struct {
+	batch_material_s materials[BATCH_MAX_MATERIALS];
+	int material_count;
+	batch_stats_s stats;	/* of the last batch_draw() */
+} batch_s;
+
+/*
+ * @brief Register a material
+ * @return material id, -1 if there are too many materials
+ */
+int batch_material_add(batch_s *batch, GLuint program, batch_blend_e blend);
+
+/*
+ * @brief Merge a mesh into the static bucket of a material. The merged
+ *        buffers are uploaded by the next batch_draw().
+ * @param[in] indices triangle list indices, relative to <vertices>
+ * @return EINA_TRUE on success
+ */
+Eina_Bool batch_add_static(batch_s *batch, int material, const batch_vertex_s *vertices, int vertexCount,
+		const GLushort *indices, int indexCount);
+
+/*
+ * @brief Empty every dynamic bucket; call before adding this frame's dynamic meshes
+ */
+void batch_begin_dynamic(batch_s *batch);
+
+/*
+ * @brief Append a mesh to the dynamic bucket of a material for this frame
+ * @return EINA_TRUE on success
+ */
+Eina_Bool batch_add_dynamic(batch_s *batch, int material, const batch_vertex_s *vertices, int vertexCount,
+		const GLushort *indices, int indexCount);
+
+/*
+ * @brief Upload what changed and draw every bucket, one draw per non-empty
+ *        bucket
+ */
+void batch_draw(batch_s *batch);
+
+/*
+ * @brief Release buffers and CPU copies
+ */
+void batch_destroy(batch_s *batch);
+
+#endif /* BATCH_H_ */
@@ -16,4 +16,35 @@
 #define PACKAGE "org.example.glviewexample"
 #endif
 
+/*
+ * Frames are only drawn when the scene changed since the last one. Changes
+ * are marked with mark_dirty(); the animator freezes itself on the first
+ * tick that finds nothing dirty and is thawed by the next change. The
+ * default scene is static and draws once; the turning model and the
+ * BATCH_STRESS moving triangles leave every frame dirty.
+ */
+typedef enum {
+	DIRTY_VIEW = 1 << 0,	// new surface or size
+	DIRTY_SCENE = 1 << 1,	// batched meshes added or moved
+	DIRTY_MESH = 1 << 2,	// model loaded
+	DIRTY_UNIFORMS = 1 << 3,	// transforms changed
+} dirty_flags_e;
+
+/*
+ * Model drawn at startup, imported from res/ into a binary mesh in the
+ * data directory on first run (see mesh.h)
+ */
+#define MESH_MODEL_NAME "teapot.obj"
+#define MESH_BINARY_NAME "teapot.mshb"
+
+/*
+ * Build with -DBATCH_STRESS to replace the triangle with BATCH_STRESS_STATIC
+ * static quads and BATCH_STRESS_DYNAMIC moving triangles, drawn through the
+ * batcher (see batch.h). Draw and mesh counts are logged every
+ * BATCH_STATS_FRAMES frames.
+ */
+#define BATCH_STRESS_STATIC 10000
+#define BATCH_STRESS_DYNAMIC 2000
+#define BATCH_STATS_FRAMES 300
+
 #endif /* __glviewexample_H__ */
@@ -0,0 +1,109 @@
+/*
+ * mesh.h
+ *
+ * Mesh import pipeline: OBJ -> optimized, quantized binary mesh.
+ *
+ * mesh_load() memory-maps a model, triangulates it and welds identical
+ * position/normal pairs, then
+ *   - reorders the triangles for the post-transform vertex cache (Forsyth),
+ *   - renumbers the vertices in first use order for fetch locality,
+ *   - quantizes positions to 16-bit snorm relative to the bounding box and
+ *     normals to 2_10_10_10 snorm, 12 bytes per vertex instead of 24.
+ * The result is written next to the app data as a binary file whose vertex
+ * and index blocks are laid out exactly as GL wants them, so later starts
+ * map it and hand the blocks straight to glBufferData() without parsing.
+ * The binary is rebuilt whenever the size or mtime of the source changes.
+ *
+ * Nothing in here depends on EFL or GL.
+ */
+
+#ifndef MESH_H_
+#define MESH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MESH_MAGIC 0x4248534d /* "MSHB" */
+#define MESH_VERSION 1
+#define MESH_CACHE_SIZE 32	/* vertex cache size the index order is tuned for */
+#define MESH_FIFO_SIZE 16	/* FIFO cache size used to report ACMR */
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t index_size;		/* 2 or 4 bytes */
+	uint32_t vertex_stride;		/* sizeof(mesh_vertex_s) */
+	uint32_t vertex_offset;		/* file offset of the vertex block */
+	uint32_t index_offset;		/* file offset of the index block */
+	float position_scale[3];	/* position = snorm * scale + offset */
+	float position_offset[3];
+	float acmr;			/* average cache miss ratio after optimization */
+	uint32_t reserved;
+	uint64_t source_size;		/* size and mtime of the source model */
+	int64_t source_mtime;
+} mesh_header_s;
+
+/*
+ * Packed vertex: position as normalized GL_SHORT x4 (w unused), normal as
+ * normalized GL_INT_2_10_10_10_REV
+ */
+typedef struct {
+	int16_t position[4];
+	uint32_t normal;
+} mesh_vertex_s;
+
+/*
+ * A mapped binary mesh. <vertices> and <indices> point into the mapping.
+ */
+typedef struct {
+	void *map;
+	size_t size;
+	const mesh_header_s *header;
+	const void *vertices;
+	const void *indices;
+} mesh_s;
+
+/*
+ * @brief Map the binary mesh for <source>, importing it first if the binary
+ *        is missing or out of date
+ * @param[in] source OBJ model
+ * @param[in] binary path of the binary mesh
+ * @return 0 on success, -1 on failure
+ */
+int mesh_load(mesh_s *mesh, const char *source, const char *binary);
+
+/*
+ * @brief Release the mapping
+ */
+void mesh_unmap(mesh_s *mesh);
+
+/*
+ * @brief Import an OBJ model into a binary mesh
+ * @return 0 on success, -1 on failure
+ */
+int mesh_import_obj(const char *source, const char *binary);
+
+/*
+ * @brief Reorder triangles for a vertex cache of MESH_CACHE_SIZE entries
+ * @param[in,out] indices triangle list
+ * @return 0 on success, -1 if out of memory
+ */
+int mesh_optimize_vertex_cache(uint32_t *indices, int indexCount, int vertexCount);
+
+/*
+ * @brief Renumber vertices in the order the indices first use them
+ * @param[in,out] indices triangle list, rewritten with the new numbering
+ * @param[out] remap remap[old] = new, vertexCount entries
+ * @return number of vertices used
+ */
+int mesh_optimize_vertex_fetch(uint32_t *indices, int indexCount, int vertexCount, uint32_t *remap);
+
+/*
+ * @brief Average cache miss ratio (transformed vertices per triangle) of a
+ *        FIFO cache
+ */
+float mesh_acmr(const uint32_t *indices, int indexCount, int vertexCount, int cacheSize);
+
+#endif /* MESH_H_ */
@@ -0,0 +1,221 @@
+/*
+ * batch.c
+ *
+ * Geometry batching, see batch.h.
+ */
+
+#include "batch.h"
+
+#include <string.h>
+#include <stddef.h>
+#include <dlog.h>
+
+#include "glviewexample.h"
+#include <Elementary_GL_Helpers.h>
+
+ELEMENTARY_GLVIEW_GLOBAL_DECLARE();
+
+/*
+ * @brief Grow <*array> to hold at least <needed> elements, doubling the capacity
+ * @return EINA_TRUE if the array is large enough
+ */
+static Eina_Bool reserve(void **array, int *capacity, int needed, size_t elementSize)
+{
+	if (needed <= *capacity) {
+		return EINA_TRUE;
+	}
+	int newCapacity = *capacity ? *capacity : 256;
+	while (newCapacity < needed) {
+		newCapacity *= 2;
+	}
+	void *grown = realloc(*array, (size_t)newCapacity * elementSize);
+	if (!grown) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "batch: out of memory for %d elements", needed);
+		return EINA_FALSE;
+	}
+	*array = grown;
+	*capacity = newCapacity;
+	return EINA_TRUE;
+}
+
+static Eina_Bool bucket_append(batch_bucket_s *bucket, const batch_vertex_s *vertices, int vertexCount,
+		const GLushort *indices, int indexCount)
+{
+	if (!reserve((void **)&bucket->vertices, &bucket->vertex_capacity, bucket->vertex_count + vertexCount,
+			sizeof(batch_vertex_s)) ||
+			!reserve((void **)&bucket->indices, &bucket->index_capacity, bucket->index_count + indexCount,
+			sizeof(GLuint))) {
+		return EINA_FALSE;
+	}
+
+	/* Rebase the mesh indices onto the merged vertex array */
+	GLuint base = bucket->vertex_count;
+	memcpy(&bucket->vertices[bucket->vertex_count], vertices, vertexCount * sizeof(batch_vertex_s));
+	for (int i = 0; i < indexCount; ++i) {
+		bucket->indices[bucket->index_count + i] = base + indices[i];
+	}
+	bucket->vertex_count += vertexCount;
+	bucket->index_count += indexCount;
+	bucket->mesh_count++;
+	bucket->dirty = EINA_TRUE;
+	return EINA_TRUE;
+}
+
+/*
+ * @brief Copy the CPU arrays of a bucket into its GL buffers
+ * @param[in] usage GL_STATIC_DRAW for merged static meshes, GL_STREAM_DRAW
+ *            for the per-frame dynamic ones
+ */
+static void bucket_upload(batch_bucket_s *bucket, GLenum usage, batch_stats_s *stats)
+{
+	GLsizeiptr vertexBytes = bucket->vertex_count * sizeof(batch_vertex_s);
+	GLsizeiptr indexBytes = bucket->index_count * sizeof(GLuint);
+
+	if (!bucket->vbo) {
+		glGenBuffers(1, &bucket->vbo);
+		glGenBuffers(1, &bucket->ibo);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, bucket->vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bucket->ibo);
+	if (usage == GL_STATIC_DRAW) {
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, bucket->vertices, usage);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, bucket->indices, usage);
+		bucket->vbo_size = vertexBytes;
+		bucket->ibo_size = indexBytes;
+	} else {
+		/* Orphan the storage so the driver never waits for last frame's draw */
+		if (vertexBytes > bucket->vbo_size) {
+			bucket->vbo_size = bucket->vertex_capacity * sizeof(batch_vertex_s);
+		}
+		if (indexBytes > bucket->ibo_size) {
+			bucket->ibo_size = bucket->index_capacity * sizeof(GLuint);
+		}
+		glBufferData(GL_ARRAY_BUFFER, bucket->vbo_size, NULL, usage);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, vertexBytes, bucket->vertices);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, bucket->ibo_size, NULL, usage);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, indexBytes, bucket->indices);
+	}
+	bucket->dirty = EINA_FALSE;
+	stats->uploads++;
+}
+
+static void bucket_draw(batch_bucket_s *bucket, GLenum usage, batch_stats_s *stats)
+{
+	if (bucket->index_count == 0) {
+		return;
+	}
+	if (bucket->dirty) {
+		bucket_upload(bucket, usage, stats);
+	} else {
+		glBindBuffer(GL_ARRAY_BUFFER, bucket->vbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bucket->ibo);
+	}
+
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(batch_vertex_s),
+			(const void *)offsetof(batch_vertex_s, position));
+	glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(batch_vertex_s),
+			(const void *)offsetof(batch_vertex_s, color));
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	glDrawElements(GL_TRIANGLES, bucket->index_count, GL_UNSIGNED_INT, (const void *)0);
+
+	stats->draws++;
+	stats->meshes += bucket->mesh_count;
+	stats->vertices += bucket->vertex_count;
+}
+
+static void bucket_destroy(batch_bucket_s *bucket)
+{
+	if (bucket->vbo) {
+		glDeleteBuffers(1, &bucket->vbo);
+		glDeleteBuffers(1, &bucket->ibo);
+	}
+	free(bucket->vertices);
+	free(bucket->indices);
+	memset(bucket, 0, sizeof(*bucket));
+}
+
+int batch_material_add(batch_s *batch, GLuint program, batch_blend_e blend)
+{
+	if (batch->material_count >= BATCH_MAX_MATERIALS) {
+		return -1;
+	}
+	batch_material_s *material = &batch->materials[batch->material_count];
+	memset(material, 0, sizeof(*material));
+	material->program = program;
+	material->blend = blend;
+	return batch->material_count++;
+}
+
+Eina_Bool batch_add_static(batch_s *batch, int material, const batch_vertex_s *vertices, int vertexCount,
+		const GLushort *indices, int indexCount)
+{
+	if (material < 0 || material >= batch->material_count) {
+		return EINA_FALSE;
+	}
+	return bucket_append(&batch->materials[material].static_bucket, vertices, vertexCount, indices, indexCount);
+}
+
+void batch_begin_dynamic(batch_s *batch)
+{
+	for (int i = 0; i < batch->material_count; ++i) {
+		batch_bucket_s *bucket = &batch->materials[i].dynamic_bucket;
+		bucket->vertex_count = 0;
+		bucket->index_count = 0;
+		bucket->mesh_count = 0;
+		bucket->dirty = EINA_TRUE;
+	}
+}
+
+Eina_Bool batch_add_dynamic(batch_s *batch, int material, const batch_vertex_s *vertices, int vertexCount,
+		const GLushort *indices, int indexCount)
+{
+	if (material < 0 || material >= batch->material_count) {
+		return EINA_FALSE;
+	}
+	return bucket_append(&batch->materials[material].dynamic_bucket, vertices, vertexCount, indices, indexCount);
+}
+
+void batch_draw(batch_s *batch)
+{
+	GLuint program = 0;
+
+	memset(&batch->stats, 0, sizeof(batch->stats));
+	for (int i = 0; i < batch->material_count; ++i) {
+		batch_material_s *material = &batch->materials[i];
+		if (material->static_bucket.index_count == 0 && material->dynamic_bucket.index_count == 0) {
+			continue;
+		}
+
+		if (material->program != program) {
+			program = material->program;
+			glUseProgram(program);
+		}
+		if (material->blend == BATCH_BLEND_ALPHA) {
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		} else {
+			glDisable(GL_BLEND);
+		}
+
+		bucket_draw(&material->static_bucket, GL_STATIC_DRAW, &batch->stats);
+		bucket_draw(&material->dynamic_bucket, GL_STREAM_DRAW, &batch->stats);
+	}
+
+	/* Left enabled, they would point other draws at the batch buffers */
+	glDisableVertexAttribArray(0);
+	glDisableVertexAttribArray(1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void batch_destroy(batch_s *batch)
+{
+	for (int i = 0; i < batch->material_count; ++i) {
+		bucket_destroy(&batch->materials[i].static_bucket);
+		bucket_destroy(&batch->materials[i].dynamic_bucket);
+	}
+	batch->material_count = 0;
+}
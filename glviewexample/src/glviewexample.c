@@ -15,6 +15,14 @@
  */
 
 #include "glviewexample.h"
+#include "batch.h"
+#include "mesh.h"
+#include <limits.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 /*
  * The file Elementary_GL_Helpers.h provies some convenience functions
  * that ease the use of OpenGL within Elementary application.
@@ -33,11 +41,28 @@ typedef struct appdata {
 	Evas_Object *conform;
 	Evas_Object *glview;
 	Ecore_Animator *ani;
+	Eina_Bool ani_frozen;
+	Eina_Bool paused;	// hidden, nothing is drawn
+	unsigned int dirty;	// dirty_flags_e to redraw for
 	int glview_h, glview_w;
 
 	/* GL related data here... */
 	unsigned int program;
 
+	// meshes merged per material, see batch.h
+	batch_s batch;
+	int opaque_material;
+	int overlay_material;
+	int frame;
+
+	// model loaded through the mesh pipeline, see mesh.h
+	GLuint mesh_program;
+	GLint mvpLoc, scaleLoc;
+	GLuint mesh_vbo, mesh_ibo;
+	GLsizei mesh_index_count;
+	GLenum mesh_index_type;
+	GLfloat mesh_scale[3];
+
 	Eina_Bool initialized;
 } appdata_s;
 
@@ -45,27 +70,62 @@ typedef struct appdata {
 static const char vShaderStrshaderSrc[] =
 		"#version 300 es\n"
 		"layout(location = 0) in vec4 aPos;\n"
+		"layout(location = 1) in vec4 aColor;\n"
+		"out vec4 vColor;\n"
 		"void main()\n"
 		"{\n"
 		"    gl_Position = aPos;\n"
+		"    vColor = aColor;\n"
 		"}";
 
 /* Fragment Shader Source */
 static const char fShaderStr[] =
 		"#version 300 es\n"
 		"precision mediump float;\n"
+		"in vec4 vColor;\n"
 		"out vec4 fragColor;\n"
 		"\n"
 		"void main (void)\n"
 		"{\n"
-		"    fragColor = vec4(1.0f, 0.5f, 0.2f, 1.0f);\n"
+		"    fragColor = vColor;\n"
+		"}";
+
+/*
+ * Mesh shaders: positions arrive as snorm16 relative to the bounding box,
+ * so u_scale restores the model size around its center
+ */
+static const char vMeshShaderStr[] =
+		"#version 300 es\n"
+		"uniform mat4 u_mvp;\n"
+		"uniform vec3 u_scale;\n"
+		"layout(location = 0) in vec4 aPosition;\n"
+		"layout(location = 2) in vec4 aNormal;\n"
+		"out vec3 vNormal;\n"
+		"void main()\n"
+		"{\n"
+		"    gl_Position = u_mvp * vec4(aPosition.xyz * u_scale, 1.0);\n"
+		"    vNormal = mat3(u_mvp) * aNormal.xyz;\n"
 		"}";
 
-static const float vertices[] = {
-    -0.5f, -0.5f, 0.0f,
-     0.5f, -0.5f, 0.0f,
-     0.0f,  0.5f, 0.0f
+static const char fMeshShaderStr[] =
+		"#version 300 es\n"
+		"precision mediump float;\n"
+		"in vec3 vNormal;\n"
+		"out vec4 fragColor;\n"
+		"\n"
+		"void main (void)\n"
+		"{\n"
+		"    float light = max(dot(normalize(vNormal), vec3(0.3, 0.5, -0.8)), 0.0);\n"
+		"    fragColor = vec4(vec3(1.0, 0.5, 0.2) * (0.2 + 0.8 * light), 1.0);\n"
+		"}";
+
+static const batch_vertex_s vertices[] = {
+    { { -0.5f, -0.5f, 0.0f }, { 255, 128, 51, 255 } },
+    { {  0.5f, -0.5f, 0.0f }, { 255, 128, 51, 255 } },
+    { {  0.0f,  0.5f, 0.0f }, { 255, 128, 51, 255 } }
 };
+static const GLushort triangleIndices[] = { 0, 1, 2 };
+static const GLushort quadIndices[] = { 0, 1, 2, 2, 1, 3 };
 
 /*
  * @brief Hide the window when back button is pressed
@@ -111,26 +171,24 @@ GLuint LoadShader(GLenum type, const char *shaderSrc)
 }
 
 /*
- * @brief Initialize vertex & fragment shaders
- * @param[in] obj GLView object
+ * @brief Create a program from vertex & fragment shader sources
+ * @return program object, 0 on compile or link failure
  */
-static void init_shaders(Evas_Object *obj)
+static GLuint CreateProgram(const char *vertexShaderSrc, const char *fragmentShaderSrc)
 {
-	appdata_s *ad = evas_object_data_get(obj, "ad");
-
 	/* Load the vertex/fragment shaders */
-	GLuint vertexShader = LoadShader(GL_VERTEX_SHADER, vShaderStrshaderSrc);
+	GLuint vertexShader = LoadShader(GL_VERTEX_SHADER, vertexShaderSrc);
 	if (vertexShader == 0) {
-		return;
+		return 0;
 	}
-	GLuint fragmentShader = LoadShader(GL_FRAGMENT_SHADER, fShaderStr);
+	GLuint fragmentShader = LoadShader(GL_FRAGMENT_SHADER, fragmentShaderSrc);
 	if (fragmentShader == 0) {
-		return;
+		return 0;
 	}
 	/* Create the program object */
 	GLuint program = glCreateProgram();
 	if (program == 0) {
-		return;
+		return 0;
 	}
 	glAttachShader(program, vertexShader);
 	glAttachShader(program, fragmentShader);
@@ -150,13 +208,134 @@ static void init_shaders(Evas_Object *obj)
 			free(infoLog);
 		}
 		glDeleteProgram(program);
-		return;
+		return 0;
 	}
-	/* Store the program object */
-	ad->program = program;
 
 	glDeleteShader(vertexShader);
 	glDeleteShader(fragmentShader);
+	return program;
+}
+
+/*
+ * @brief Initialize vertex & fragment shaders
+ * @param[in] obj GLView object
+ */
+static void init_shaders(Evas_Object *obj)
+{
+	appdata_s *ad = evas_object_data_get(obj, "ad");
+
+	/* Store the program objects */
+	ad->program = CreateProgram(vShaderStrshaderSrc, fShaderStr);
+	ad->mesh_program = CreateProgram(vMeshShaderStr, fMeshShaderStr);
+	if (ad->mesh_program) {
+		ad->mvpLoc = glGetUniformLocation(ad->mesh_program, "u_mvp");
+		ad->scaleLoc = glGetUniformLocation(ad->mesh_program, "u_scale");
+	}
+}
+
+/*
+ * @brief Request a redraw for <flags> (dirty_flags_e), waking the animator
+ *        if it froze itself
+ */
+static void mark_dirty(appdata_s *ad, unsigned int flags)
+{
+	ad->dirty |= flags;
+	if (ad->ani_frozen && ad->ani && !ad->paused) {
+		ad->ani_frozen = EINA_FALSE;
+		ecore_animator_thaw(ad->ani);
+	}
+}
+
+/*
+ * @brief Load the model and upload it straight from the mapped binary mesh
+ */
+static void init_mesh(appdata_s *ad)
+{
+	char source[PATH_MAX], binary[PATH_MAX];
+	struct timespec start, end;
+
+	char *res_path = app_get_resource_path();
+	char *data_path = app_get_data_path();
+	snprintf(source, sizeof(source), "%s%s", res_path ? res_path : "", MESH_MODEL_NAME);
+	snprintf(binary, sizeof(binary), "%s%s", data_path ? data_path : "", MESH_BINARY_NAME);
+	free(res_path);
+	free(data_path);
+
+	mesh_s mesh;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (mesh_load(&mesh, source, binary) != 0) {
+		dlog_print(DLOG_WARN, LOG_TAG, "mesh: could not load %s", source);
+		return;
+	}
+	const mesh_header_s *header = mesh.header;
+
+	glGenBuffers(1, &ad->mesh_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, ad->mesh_vbo);
+	glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)header->vertex_count * header->vertex_stride, mesh.vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glGenBuffers(1, &ad->mesh_ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ad->mesh_ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)header->index_count * header->index_size, mesh.indices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	ad->mesh_index_count = header->index_count;
+	ad->mesh_index_type = (header->index_size == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	memcpy(ad->mesh_scale, header->position_scale, sizeof(ad->mesh_scale));
+	mark_dirty(ad, DIRTY_MESH);
+	dlog_print(DLOG_INFO, LOG_TAG, "mesh: %u vertices, %u triangles, ACMR %.3f, loaded in %.2f ms",
+			header->vertex_count, header->index_count / 3, header->acmr,
+			(end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+	mesh_unmap(&mesh);
+}
+
+/*
+ * @brief Draw the model turning around the vertical axis
+ */
+static void draw_mesh(appdata_s *ad)
+{
+	if (!ad->mesh_index_count || !ad->mesh_program) {
+		return;
+	}
+
+	/* Fit the bounding box in the view, keeping the aspect ratio */
+	float extent = fmaxf(ad->mesh_scale[0], fmaxf(ad->mesh_scale[1], ad->mesh_scale[2]));
+	float fit = extent > 0.0f ? 0.7f / extent : 1.0f;
+	float aspect = ad->glview_w ? (float)ad->glview_h / ad->glview_w : 1.0f;
+	float yaw = ad->frame * 0.01f, pitch = 0.4f;
+	float cy = cosf(yaw), sy = sinf(yaw), cp = cosf(pitch), sp = sinf(pitch);
+	/* Column major rotation pitch * yaw, then scale */
+	const GLfloat mvp[16] = {
+		cy * fit * aspect, sy * sp * fit, -sy * cp * fit, 0.0f,
+		0.0f, cp * fit, sp * fit, 0.0f,
+		sy * fit * aspect, -cy * sp * fit, cy * cp * fit, 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f,
+	};
+
+	glUseProgram(ad->mesh_program);
+	glUniformMatrix4fv(ad->mvpLoc, 1, GL_FALSE, mvp);
+	glUniform3fv(ad->scaleLoc, 1, ad->mesh_scale);
+	// keeps turning: the next frame has a new transform
+	mark_dirty(ad, DIRTY_UNIFORMS);
+
+	glEnable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glBindBuffer(GL_ARRAY_BUFFER, ad->mesh_vbo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ad->mesh_ibo);
+	glVertexAttribPointer(0, 4, GL_SHORT, GL_TRUE, sizeof(mesh_vertex_s),
+			(const void *)offsetof(mesh_vertex_s, position));
+	glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(mesh_vertex_s),
+			(const void *)offsetof(mesh_vertex_s, normal));
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(2);
+
+	glDrawElements(GL_TRIANGLES, ad->mesh_index_count, ad->mesh_index_type, (const void *)0);
+
+	glDisableVertexAttribArray(0);
+	glDisableVertexAttribArray(2);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glDisable(GL_DEPTH_TEST);
 }
 
 /*
@@ -171,6 +350,73 @@ static void resize_glview(Evas_Object *obj)
 	elm_glview_size_get(obj, &ad->glview_w, &ad->glview_h);
 
 	glViewport(0, 0, ad->glview_w, ad->glview_h);
+	mark_dirty(ad, DIRTY_VIEW);
+}
+
+/*
+ * @brief Set the position and color of a batch vertex
+ */
+static void set_vertex(batch_vertex_s *vertex, float x, float y, GLubyte r, GLubyte g, GLubyte b, GLubyte a)
+{
+	vertex->position[0] = x;
+	vertex->position[1] = y;
+	vertex->position[2] = 0.0f;
+	vertex->color[0] = r;
+	vertex->color[1] = g;
+	vertex->color[2] = b;
+	vertex->color[3] = a;
+}
+
+/*
+ * @brief Add the static meshes of the scene to the batch
+ */
+static void init_scene(appdata_s *ad)
+{
+	ad->opaque_material = batch_material_add(&ad->batch, ad->program, BATCH_BLEND_NONE);
+	ad->overlay_material = batch_material_add(&ad->batch, ad->program, BATCH_BLEND_ALPHA);
+
+#ifdef BATCH_STRESS
+	/* A grid of small quads, as many as the UI overlays produce */
+	int columns = (int)ceilf(sqrtf(BATCH_STRESS_STATIC));
+	float cell = 2.0f / columns;
+	for (int i = 0; i < BATCH_STRESS_STATIC; ++i) {
+		float x = -1.0f + (i % columns) * cell;
+		float y = -1.0f + (i / columns) * cell;
+		float size = cell * 0.8f;
+		GLubyte r = 64 + (i * 37) % 192, g = 64 + (i * 91) % 192, b = 64 + (i * 53) % 192;
+		batch_vertex_s quad[4];
+		set_vertex(&quad[0], x, y, r, g, b, 255);
+		set_vertex(&quad[1], x + size, y, r, g, b, 255);
+		set_vertex(&quad[2], x, y + size, r, g, b, 255);
+		set_vertex(&quad[3], x + size, y + size, r, g, b, 255);
+		batch_add_static(&ad->batch, ad->opaque_material, quad, 4, quadIndices, 6);
+	}
+#else
+	batch_add_static(&ad->batch, ad->opaque_material, vertices, 3, triangleIndices, 3);
+#endif
+	mark_dirty(ad, DIRTY_SCENE);
+}
+
+/*
+ * @brief Refill the dynamic bucket with this frame's moving meshes
+ */
+static void update_scene(appdata_s *ad)
+{
+	batch_begin_dynamic(&ad->batch);
+#ifdef BATCH_STRESS
+	float time = ad->frame / 60.0f;
+	for (int i = 0; i < BATCH_STRESS_DYNAMIC; ++i) {
+		float angle = time + i * 0.01f;
+		float radius = 0.2f + 0.7f * (float)i / BATCH_STRESS_DYNAMIC;
+		float x = cosf(angle) * radius, y = sinf(angle * 1.1f) * radius;
+		batch_vertex_s triangle[3];
+		set_vertex(&triangle[0], x - 0.01f, y - 0.01f, 255, 255, 255, 96);
+		set_vertex(&triangle[1], x + 0.01f, y - 0.01f, 255, 255, 255, 96);
+		set_vertex(&triangle[2], x, y + 0.01f, 255, 255, 255, 96);
+		batch_add_dynamic(&ad->batch, ad->overlay_material, triangle, 3, triangleIndices, 3);
+	}
+	mark_dirty(ad, DIRTY_SCENE);
+#endif
 }
 
 /*
@@ -181,17 +427,24 @@ static void draw_glview(Evas_Object *obj)
 {
 	appdata_s *ad = evas_object_data_get(obj, "ad");
 
+	// Whatever changes during this frame asks for the next one
+	ad->dirty = 0;
+
 	// Clear the color buffer
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// Use the program object
-	glUseProgram(ad->program);
-	// Load the vertex data
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, vertices);
-	glEnableVertexAttribArray(0);
+	draw_mesh(ad);
 
-	glDrawArrays(GL_TRIANGLES, 0, 3);
+	// One draw per material and bucket, whatever the number of meshes
+	update_scene(ad);
+	batch_draw(&ad->batch);
+
+	if (++ad->frame % BATCH_STATS_FRAMES == 0) {
+		const batch_stats_s *stats = &ad->batch.stats;
+		dlog_print(DLOG_INFO, LOG_TAG, "batch: %d meshes, %d vertices in %d draws, %d uploads",
+				stats->meshes, stats->vertices, stats->draws, stats->uploads);
+	}
 
 	glFlush();
 }
@@ -206,6 +459,8 @@ static void init_glview(Evas_Object *obj)
 
 	if (!ad->initialized) {
 		init_shaders(obj);
+		init_mesh(ad);
+		init_scene(ad);
 		ad->initialized = EINA_TRUE;
 	}
 }
@@ -219,6 +474,10 @@ static void del_glview(Evas_Object *obj)
 	appdata_s *ad = evas_object_data_get(obj, "ad");
 
 	/* Release resources. */
+	batch_destroy(&ad->batch);
+	glDeleteBuffers(1, &ad->mesh_vbo);
+	glDeleteBuffers(1, &ad->mesh_ibo);
+	glDeleteProgram(ad->mesh_program);
 	glDeleteProgram(ad->program);
 
 	evas_object_data_del((Evas_Object*) obj, "ad");
@@ -232,15 +491,25 @@ static void del_anim(void *data, Evas *evas, Evas_Object *obj, void *event_info)
 {
 	appdata_s *ad = data;
 	ecore_animator_del(ad->ani);
+	ad->ani = NULL;
 }
 
 /*
- * @brief Animator makes GLView to draw new frame
- * param[in] data GLView object
+ * @brief Animator makes GLView to draw new frame when the scene is dirty,
+ *        and freezes itself when it is not
+ * param[in] data appdata
  */
 static Eina_Bool anim(void *data)
 {
-	elm_glview_changed_set(data);
+	appdata_s *ad = data;
+
+	if (ad->dirty) {
+		elm_glview_changed_set(ad->glview);
+	} else {
+		dlog_print(DLOG_INFO, LOG_TAG, "render: scene unchanged after frame %d, animator frozen", ad->frame);
+		ad->ani_frozen = EINA_TRUE;
+		ecore_animator_freeze(ad->ani);
+	}
 	return EINA_TRUE;
 }
 
@@ -314,7 +583,9 @@ static void create_glview(appdata_s *ad)
 	 * NOTE: If you delete GL, this animator will keep running trying to access
 	 * GL so this animator needs to be deleted with ecore_animator_del().
 	 */
-	ad->ani = ecore_animator_add(anim, ad->glview);
+	ad->ani = ecore_animator_add(anim, ad);
+	ad->ani_frozen = EINA_FALSE;
+	ad->dirty = DIRTY_VIEW;
 	evas_object_event_callback_add(ad->glview, EVAS_CALLBACK_DEL, del_anim, ad);
 }
 
@@ -406,7 +677,11 @@ static void app_pause(void *data)
 	 * When app is paused,
 	 * Freeze animator for power saving
 	 */
-	ecore_animator_freeze(ad->ani);
+	ad->paused = EINA_TRUE;
+	if (ad->ani && !ad->ani_frozen) {
+		ad->ani_frozen = EINA_TRUE;
+		ecore_animator_freeze(ad->ani);
+	}
 }
 
 static void app_resume(void *data)
@@ -414,8 +689,9 @@ static void app_resume(void *data)
 	dlog_print(DLOG_DEBUG, LOG_TAG, "app_resume");
 
 	appdata_s *ad = data;
-	/* When app is resumed, thaw animator */
-	ecore_animator_thaw(ad->ani);
+	/* When app is resumed, thaw animator and redraw once: the surface may be new */
+	ad->paused = EINA_FALSE;
+	mark_dirty(ad, DIRTY_VIEW);
 }
 
 static void app_terminate(void *data)
@@ -0,0 +1,742 @@
+/*
+ * mesh.c
+ *
+ * Mesh import pipeline, see mesh.h.
+ */
+
+#include "mesh.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define OBJ_MAX_POLYGON 64
+
+/* Forsyth's scoring constants */
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRIANGLE_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// OBJ parsing, straight from the mapping
+
+static const char *skip_space(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+		p++;
+	}
+	return p;
+}
+
+static const char *next_line(const char *p, const char *end)
+{
+	while (p < end && *p != '\n') {
+		p++;
+	}
+	return p < end ? p + 1 : end;
+}
+
+/*
+ * @brief Parse a decimal number; unlike strtof() this never reads past <end>,
+ *        which matters because the mapping is not NUL terminated
+ * @return 1 on success
+ */
+static int parse_float(const char **cursor, const char *end, float *value)
+{
+	const char *p = skip_space(*cursor, end);
+	double sign = 1.0, result = 0.0;
+	int digits = 0;
+
+	if (p < end && (*p == '-' || *p == '+')) {
+		sign = (*p++ == '-') ? -1.0 : 1.0;
+	}
+	while (p < end && *p >= '0' && *p <= '9') {
+		result = result * 10.0 + (*p++ - '0');
+		digits++;
+	}
+	if (p < end && *p == '.') {
+		double scale = 0.1;
+		for (p++; p < end && *p >= '0' && *p <= '9'; p++, scale *= 0.1) {
+			result += (*p - '0') * scale;
+			digits++;
+		}
+	}
+	if (!digits) {
+		return 0;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		int exponentSign = 1, exponent = 0;
+		p++;
+		if (p < end && (*p == '-' || *p == '+')) {
+			exponentSign = (*p++ == '-') ? -1 : 1;
+		}
+		while (p < end && *p >= '0' && *p <= '9') {
+			exponent = exponent * 10 + (*p++ - '0');
+		}
+		result *= pow(10.0, exponentSign * exponent);
+	}
+	*value = (float)(sign * result);
+	*cursor = p;
+	return 1;
+}
+
+static int parse_int(const char **cursor, const char *end, long *value)
+{
+	const char *p = *cursor;
+	long sign = 1, result = 0;
+	int digits = 0;
+
+	if (p < end && *p == '-') {
+		sign = -1;
+		p++;
+	}
+	while (p < end && *p >= '0' && *p <= '9') {
+		result = result * 10 + (*p++ - '0');
+		digits++;
+	}
+	*value = sign * result;
+	*cursor = p;
+	return digits > 0;
+}
+
+/*
+ * @brief Resolve a 1-based, possibly negative (relative) OBJ index
+ * @return 0-based index, -1 if out of range
+ */
+static long resolve_index(long index, long count)
+{
+	index = (index < 0) ? count + index : index - 1;
+	return (index >= 0 && index < count) ? index : -1;
+}
+
+typedef struct {
+	float *positions;	/* 3 per OBJ position */
+	float *normals;		/* 3 per OBJ normal */
+	long position_count, normal_count;
+
+	/* welded vertices: OBJ position and normal index (-1 if none) */
+	long *vertex_position, *vertex_normal;
+	long vertex_count;
+	uint32_t *indices;
+	long index_count;
+
+	uint32_t *table;	/* weld hash table, vertex + 1, 0 when empty */
+	size_t table_mask;
+} obj_s;
+
+static uint32_t weld(obj_s *obj, long position, long normal)
+{
+	size_t hash = ((size_t)position * 73856093u) ^ ((size_t)(normal + 1) * 19349663u);
+	for (size_t slot = hash & obj->table_mask;; slot = (slot + 1) & obj->table_mask) {
+		uint32_t entry = obj->table[slot];
+		if (entry == 0) {
+			obj->vertex_position[obj->vertex_count] = position;
+			obj->vertex_normal[obj->vertex_count] = normal;
+			obj->table[slot] = (uint32_t)++obj->vertex_count;
+			return (uint32_t)(obj->vertex_count - 1);
+		}
+		if (obj->vertex_position[entry - 1] == position && obj->vertex_normal[entry - 1] == normal) {
+			return entry - 1;
+		}
+	}
+}
+
+static void obj_free(obj_s *obj)
+{
+	free(obj->positions);
+	free(obj->normals);
+	free(obj->vertex_position);
+	free(obj->vertex_normal);
+	free(obj->indices);
+	free(obj->table);
+}
+
+static int obj_parse(obj_s *obj, const char *data, size_t size)
+{
+	const char *end = data + size;
+	long triangles = 0;
+
+	memset(obj, 0, sizeof(*obj));
+
+	/* First pass: count, so every array is allocated once */
+	for (const char *p = data; p < end; p = next_line(p, end)) {
+		p = skip_space(p, end);
+		if (end - p > 2 && p[0] == 'v' && p[1] == ' ') {
+			obj->position_count++;
+		} else if (end - p > 3 && p[0] == 'v' && p[1] == 'n' && p[2] == ' ') {
+			obj->normal_count++;
+		} else if (end - p > 2 && p[0] == 'f' && p[1] == ' ') {
+			int corners = 0;
+			for (const char *q = p + 1; q < end && *q != '\n';) {
+				q = skip_space(q, end);
+				if (q < end && *q != '\n') {
+					corners++;
+					while (q < end && *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n') {
+						q++;
+					}
+				}
+			}
+			if (corners >= 3) {
+				triangles += corners - 2;
+			}
+		}
+	}
+	if (!obj->position_count || !triangles) {
+		return -1;
+	}
+
+	size_t tableSize = 1;
+	while (tableSize < (size_t)triangles * 3 * 2) {
+		tableSize <<= 1;
+	}
+	obj->positions = malloc(obj->position_count * 3 * sizeof(float));
+	obj->normals = malloc((obj->normal_count ? obj->normal_count : 1) * 3 * sizeof(float));
+	obj->vertex_position = malloc(triangles * 3 * sizeof(long));
+	obj->vertex_normal = malloc(triangles * 3 * sizeof(long));
+	obj->indices = malloc(triangles * 3 * sizeof(uint32_t));
+	obj->table = calloc(tableSize, sizeof(uint32_t));
+	obj->table_mask = tableSize - 1;
+	if (!obj->positions || !obj->normals || !obj->vertex_position || !obj->vertex_normal ||
+			!obj->indices || !obj->table) {
+		return -1;
+	}
+
+	/* Second pass: fill, triangulating polygons as fans */
+	long positions = 0, normals = 0;
+	for (const char *p = data; p < end; p = next_line(p, end)) {
+		p = skip_space(p, end);
+		if (end - p > 2 && p[0] == 'v' && p[1] == ' ') {
+			const char *q = p + 2;
+			float *v = &obj->positions[positions++ * 3];
+			if (!parse_float(&q, end, &v[0]) || !parse_float(&q, end, &v[1]) || !parse_float(&q, end, &v[2])) {
+				return -1;
+			}
+		} else if (end - p > 3 && p[0] == 'v' && p[1] == 'n' && p[2] == ' ') {
+			const char *q = p + 3;
+			float *n = &obj->normals[normals++ * 3];
+			if (!parse_float(&q, end, &n[0]) || !parse_float(&q, end, &n[1]) || !parse_float(&q, end, &n[2])) {
+				return -1;
+			}
+		} else if (end - p > 2 && p[0] == 'f' && p[1] == ' ') {
+			/* Indices may only refer to what was declared so far */
+			long polygonPosition[OBJ_MAX_POLYGON], polygonNormal[OBJ_MAX_POLYGON];
+			int corners = 0;
+			const char *q = p + 2;
+			for (;;) {
+				long position, texcoord, normal = 0;
+				q = skip_space(q, end);
+				if (q >= end || *q == '\n' || !parse_int(&q, end, &position)) {
+					break;
+				}
+				if (q < end && *q == '/') {
+					q++;
+					parse_int(&q, end, &texcoord);
+					if (q < end && *q == '/') {
+						q++;
+						parse_int(&q, end, &normal);
+					}
+				}
+				position = resolve_index(position, positions);
+				normal = normal ? resolve_index(normal, normals) : -1;
+				if (position < 0) {
+					return -1;
+				}
+				if (corners < OBJ_MAX_POLYGON) {
+					polygonPosition[corners] = position;
+					polygonNormal[corners++] = normal;
+				}
+			}
+			/* Weld only faces that make triangles, which is what the first pass sized for */
+			if (corners < 3) {
+				continue;
+			}
+			uint32_t polygon[OBJ_MAX_POLYGON];
+			for (int i = 0; i < corners; ++i) {
+				polygon[i] = weld(obj, polygonPosition[i], polygonNormal[i]);
+			}
+			for (int i = 2; i < corners; ++i) {
+				obj->indices[obj->index_count++] = polygon[0];
+				obj->indices[obj->index_count++] = polygon[i - 1];
+				obj->indices[obj->index_count++] = polygon[i];
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+ * @brief Resolve welded vertices into flat position and normal arrays.
+ *        Vertices without a normal get the area weighted average of the
+ *        faces around their position.
+ */
+static int obj_resolve(const obj_s *obj, float *positions, float *normals)
+{
+	float *smooth = NULL;
+
+	for (long v = 0; v < obj->vertex_count; ++v) {
+		memcpy(&positions[v * 3], &obj->positions[obj->vertex_position[v] * 3], 3 * sizeof(float));
+		if (obj->vertex_normal[v] >= 0) {
+			memcpy(&normals[v * 3], &obj->normals[obj->vertex_normal[v] * 3], 3 * sizeof(float));
+		} else if (!smooth) {
+			smooth = calloc(obj->position_count * 3, sizeof(float));
+			if (!smooth) {
+				return -1;
+			}
+		}
+	}
+
+	if (smooth) {
+		for (long i = 0; i < obj->index_count; i += 3) {
+			const float *a = &positions[obj->indices[i] * 3];
+			const float *b = &positions[obj->indices[i + 1] * 3];
+			const float *c = &positions[obj->indices[i + 2] * 3];
+			float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			for (int k = 0; k < 3; ++k) {
+				float *s = &smooth[obj->vertex_position[obj->indices[i + k]] * 3];
+				s[0] += n[0];
+				s[1] += n[1];
+				s[2] += n[2];
+			}
+		}
+		for (long v = 0; v < obj->vertex_count; ++v) {
+			if (obj->vertex_normal[v] < 0) {
+				memcpy(&normals[v * 3], &smooth[obj->vertex_position[v] * 3], 3 * sizeof(float));
+			}
+		}
+		free(smooth);
+	}
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Index and vertex order
+
+static float vertex_score(int cachePosition, int remaining)
+{
+	if (remaining == 0) {
+		return -1.0f;
+	}
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			/* The last triangle's vertices; lower than the next ones so the
+			 * order does not just strip along */
+			score = LAST_TRIANGLE_SCORE;
+		} else {
+			score = powf(1.0f - (float)(cachePosition - 3) / (MESH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+		}
+	}
+	/* Finish vertices with few triangles left, so they leave the cache for good */
+	return score + VALENCE_BOOST_SCALE * powf((float)remaining, -VALENCE_BOOST_POWER);
+}
+
+int mesh_optimize_vertex_cache(uint32_t *indices, int indexCount, int vertexCount)
+{
+	int triangleCount = indexCount / 3;
+	int *remaining = calloc(vertexCount, sizeof(int));
+	int *adjacencyStart = malloc((vertexCount + 1) * sizeof(int));
+	int *adjacency = malloc(indexCount * sizeof(int));
+	int *cachePosition = malloc(vertexCount * sizeof(int));
+	float *score = malloc(vertexCount * sizeof(float));
+	float *triangleScore = malloc(triangleCount * sizeof(float));
+	unsigned char *emitted = calloc(triangleCount, 1);
+	uint32_t *output = malloc(indexCount * sizeof(uint32_t));
+	int result = -1;
+
+	if (!remaining || !adjacencyStart || !adjacency || !cachePosition || !score || !triangleScore ||
+			!emitted || !output) {
+		goto out;
+	}
+
+	/* Triangles around every vertex */
+	for (int i = 0; i < indexCount; ++i) {
+		remaining[indices[i]]++;
+	}
+	adjacencyStart[0] = 0;
+	for (int v = 0; v < vertexCount; ++v) {
+		adjacencyStart[v + 1] = adjacencyStart[v] + remaining[v];
+		remaining[v] = 0;
+	}
+	for (int i = 0; i < indexCount; ++i) {
+		uint32_t v = indices[i];
+		adjacency[adjacencyStart[v] + remaining[v]++] = i / 3;
+	}
+
+	for (int v = 0; v < vertexCount; ++v) {
+		cachePosition[v] = -1;
+		score[v] = vertex_score(-1, remaining[v]);
+	}
+	for (int t = 0; t < triangleCount; ++t) {
+		triangleScore[t] = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+	}
+
+	uint32_t cache[MESH_CACHE_SIZE + 3];
+	int cacheCount = 0;
+	int best = -1;
+
+	for (int out = 0; out < triangleCount; ++out) {
+		if (best < 0) {
+			/* Nothing in the cache has triangles left: start a new island */
+			float bestScore = -1.0f;
+			for (int t = 0; t < triangleCount; ++t) {
+				if (!emitted[t] && triangleScore[t] > bestScore) {
+					bestScore = triangleScore[t];
+					best = t;
+				}
+			}
+			if (best < 0) {
+				break;
+			}
+		}
+
+		const uint32_t *triangle = &indices[best * 3];
+		memcpy(&output[out * 3], triangle, 3 * sizeof(uint32_t));
+		emitted[best] = 1;
+
+		/* Drop the triangle from its vertices' lists */
+		for (int k = 0; k < 3; ++k) {
+			uint32_t v = triangle[k];
+			int *list = &adjacency[adjacencyStart[v]];
+			for (int i = 0; i < remaining[v]; ++i) {
+				if (list[i] == best) {
+					list[i] = list[--remaining[v]];
+					break;
+				}
+			}
+		}
+
+		/* Move the triangle's vertices to the front of the LRU cache */
+		uint32_t newCache[MESH_CACHE_SIZE + 3];
+		int newCount = 0;
+		for (int k = 0; k < 3; ++k) {
+			newCache[newCount++] = triangle[k];
+		}
+		for (int i = 0; i < cacheCount; ++i) {
+			uint32_t v = cache[i];
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+				newCache[newCount++] = v;
+			}
+		}
+		for (int i = 0; i < newCount; ++i) {
+			uint32_t v = newCache[i];
+			cachePosition[v] = (i < MESH_CACHE_SIZE) ? i : -1;
+			score[v] = vertex_score(cachePosition[v], remaining[v]);
+		}
+
+		/* Rescore the triangles that changed and pick the next one among them */
+		best = -1;
+		float bestScore = -1.0f;
+		for (int i = 0; i < newCount; ++i) {
+			uint32_t v = newCache[i];
+			for (int j = 0; j < remaining[v]; ++j) {
+				int t = adjacency[adjacencyStart[v] + j];
+				float s = score[indices[t * 3]] + score[indices[t * 3 + 1]] + score[indices[t * 3 + 2]];
+				triangleScore[t] = s;
+				if (s > bestScore) {
+					bestScore = s;
+					best = t;
+				}
+			}
+		}
+
+		cacheCount = (newCount < MESH_CACHE_SIZE) ? newCount : MESH_CACHE_SIZE;
+		memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+	}
+
+	memcpy(indices, output, triangleCount * 3 * sizeof(uint32_t));
+	result = 0;
+
+out:
+	free(remaining);
+	free(adjacencyStart);
+	free(adjacency);
+	free(cachePosition);
+	free(score);
+	free(triangleScore);
+	free(emitted);
+	free(output);
+	return result;
+}
+
+int mesh_optimize_vertex_fetch(uint32_t *indices, int indexCount, int vertexCount, uint32_t *remap)
+{
+	uint32_t next = 0;
+
+	memset(remap, 0xff, vertexCount * sizeof(uint32_t));
+	for (int i = 0; i < indexCount; ++i) {
+		uint32_t v = indices[i];
+		if (remap[v] == UINT32_MAX) {
+			remap[v] = next++;
+		}
+		indices[i] = remap[v];
+	}
+	return (int)next;
+}
+
+float mesh_acmr(const uint32_t *indices, int indexCount, int vertexCount, int cacheSize)
+{
+	/* A vertex is cached if fewer than <cacheSize> misses happened since it was loaded */
+	int64_t *loaded = malloc(vertexCount * sizeof(int64_t));
+	int64_t misses = 0;
+
+	if (!loaded || indexCount < 3) {
+		free(loaded);
+		return 0.0f;
+	}
+	for (int v = 0; v < vertexCount; ++v) {
+		loaded[v] = -(int64_t)cacheSize - 1;
+	}
+	for (int i = 0; i < indexCount; ++i) {
+		uint32_t v = indices[i];
+		if (misses - loaded[v] >= cacheSize) {
+			loaded[v] = misses++;
+		}
+	}
+	free(loaded);
+	return (float)misses / (indexCount / 3);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Quantization and the binary file
+
+static int16_t quantize_snorm16(float value)
+{
+	value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+	return (int16_t)lrintf(value * 32767.0f);
+}
+
+static uint32_t quantize_normal(const float *n)
+{
+	float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+	float scale = length > 0.0f ? 1.0f / length : 0.0f;
+	uint32_t packed = 0;
+	for (int k = 0; k < 3; ++k) {
+		int32_t q = (int32_t)lrintf(n[k] * scale * 511.0f);
+		packed |= ((uint32_t)q & 0x3ff) << (k * 10);
+	}
+	return packed;
+}
+
+/*
+ * @brief Write <size> bytes, then pad with zeros to <align>
+ */
+static int write_block(FILE *file, const void *data, size_t size, size_t align)
+{
+	static const char zeros[16];
+	size_t padding = (align - size % align) % align;
+	return (fwrite(data, 1, size, file) == size && fwrite(zeros, 1, padding, file) == padding) ? 0 : -1;
+}
+
+static int write_binary(const char *binary, mesh_header_s *header, const mesh_vertex_s *vertices,
+		const uint32_t *indices)
+{
+	char temporary[4096];
+	int result = -1;
+	void *packedIndices = (void *)indices;
+
+	if (header->index_size == 2) {
+		uint16_t *shortIndices = malloc(header->index_count * sizeof(uint16_t));
+		if (!shortIndices) {
+			return -1;
+		}
+		for (uint32_t i = 0; i < header->index_count; ++i) {
+			shortIndices[i] = (uint16_t)indices[i];
+		}
+		packedIndices = shortIndices;
+	}
+
+	/* Write aside and rename, so a crash never leaves a torn binary behind */
+	snprintf(temporary, sizeof(temporary), "%s.tmp", binary);
+	FILE *file = fopen(temporary, "wb");
+	if (file) {
+		if (write_block(file, header, sizeof(*header), 16) == 0 &&
+				write_block(file, vertices, (size_t)header->vertex_count * sizeof(mesh_vertex_s), 4) == 0 &&
+				write_block(file, packedIndices, (size_t)header->index_count * header->index_size, 4) == 0) {
+			result = 0;
+		}
+		if (fclose(file) != 0) {
+			result = -1;
+		}
+		if (result == 0 && rename(temporary, binary) != 0) {
+			result = -1;
+		}
+		if (result != 0) {
+			unlink(temporary);
+		}
+	}
+
+	if (packedIndices != indices) {
+		free(packedIndices);
+	}
+	return result;
+}
+
+static void *map_file(const char *path, size_t *size, struct stat *st)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+	void *map = MAP_FAILED;
+	if (fstat(fd, st) == 0 && st->st_size > 0) {
+		map = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+	*size = st->st_size;
+	return map;
+}
+
+int mesh_import_obj(const char *source, const char *binary)
+{
+	struct stat st;
+	size_t size;
+	obj_s obj;
+	int result = -1;
+	float *positions = NULL, *normals = NULL;
+	uint32_t *remap = NULL;
+	mesh_vertex_s *vertices = NULL;
+
+	const char *data = map_file(source, &size, &st);
+	if (!data) {
+		return -1;
+	}
+	/* Parsed front to back once per pass */
+	madvise((void *)data, size, MADV_SEQUENTIAL);
+
+	if (obj_parse(&obj, data, size) != 0) {
+		goto out;
+	}
+	int vertexCount = (int)obj.vertex_count;
+	int indexCount = (int)obj.index_count;
+
+	positions = malloc(vertexCount * 3 * sizeof(float));
+	normals = malloc(vertexCount * 3 * sizeof(float));
+	remap = malloc(vertexCount * sizeof(uint32_t));
+	vertices = malloc(vertexCount * sizeof(mesh_vertex_s));
+	if (!positions || !normals || !remap || !vertices || obj_resolve(&obj, positions, normals) != 0) {
+		goto out;
+	}
+
+	if (mesh_optimize_vertex_cache(obj.indices, indexCount, vertexCount) != 0) {
+		goto out;
+	}
+	/* Welded vertices no face uses are dropped here, remap is UINT32_MAX for them */
+	int usedCount = mesh_optimize_vertex_fetch(obj.indices, indexCount, vertexCount, remap);
+
+	mesh_header_s header = {
+		.magic = MESH_MAGIC,
+		.version = MESH_VERSION,
+		.vertex_count = usedCount,
+		.index_count = indexCount,
+		.index_size = (usedCount <= 0x10000) ? 2 : 4,
+		.vertex_stride = sizeof(mesh_vertex_s),
+		.source_size = st.st_size,
+		.source_mtime = st.st_mtime,
+	};
+	header.vertex_offset = (sizeof(header) + 15) & ~15u;
+	header.index_offset = header.vertex_offset + usedCount * sizeof(mesh_vertex_s);
+	header.acmr = mesh_acmr(obj.indices, indexCount, usedCount, MESH_FIFO_SIZE);
+
+	/* Quantize against the bounding box */
+	float lo[3] = { INFINITY, INFINITY, INFINITY }, hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+	for (int v = 0; v < vertexCount; ++v) {
+		if (remap[v] == UINT32_MAX) {
+			continue;
+		}
+		for (int k = 0; k < 3; ++k) {
+			lo[k] = fminf(lo[k], positions[v * 3 + k]);
+			hi[k] = fmaxf(hi[k], positions[v * 3 + k]);
+		}
+	}
+	for (int k = 0; k < 3; ++k) {
+		header.position_offset[k] = (lo[k] + hi[k]) * 0.5f;
+		header.position_scale[k] = (hi[k] - lo[k]) * 0.5f;
+	}
+	for (int v = 0; v < vertexCount; ++v) {
+		if (remap[v] == UINT32_MAX) {
+			continue;
+		}
+		mesh_vertex_s *out = &vertices[remap[v]];
+		for (int k = 0; k < 3; ++k) {
+			float scale = header.position_scale[k];
+			out->position[k] = scale > 0.0f ?
+					quantize_snorm16((positions[v * 3 + k] - header.position_offset[k]) / scale) : 0;
+		}
+		out->position[3] = 0;
+		out->normal = quantize_normal(&normals[v * 3]);
+	}
+
+	result = write_binary(binary, &header, vertices, obj.indices);
+
+out:
+	obj_free(&obj);
+	free(positions);
+	free(normals);
+	free(remap);
+	free(vertices);
+	munmap((void *)data, size);
+	return result;
+}
+
+/*
+ * @brief Map a binary mesh and check that its blocks are where the header says
+ * @param[in] source stat of the source model, NULL to accept any version
+ */
+static int mesh_map(mesh_s *mesh, const char *binary, const struct stat *source)
+{
+	struct stat st;
+
+	memset(mesh, 0, sizeof(*mesh));
+	mesh->map = map_file(binary, &mesh->size, &st);
+	if (!mesh->map) {
+		return -1;
+	}
+	const mesh_header_s *header = mesh->map;
+	if (mesh->size < sizeof(*header) || header->magic != MESH_MAGIC || header->version != MESH_VERSION ||
+			header->vertex_stride != sizeof(mesh_vertex_s) ||
+			(header->index_size != 2 && header->index_size != 4) ||
+			header->vertex_offset + (uint64_t)header->vertex_count * header->vertex_stride > mesh->size ||
+			header->index_offset + (uint64_t)header->index_count * header->index_size > mesh->size ||
+			(source && (header->source_size != (uint64_t)source->st_size ||
+					header->source_mtime != (int64_t)source->st_mtime))) {
+		mesh_unmap(mesh);
+		return -1;
+	}
+	mesh->header = header;
+	mesh->vertices = (const char *)mesh->map + header->vertex_offset;
+	mesh->indices = (const char *)mesh->map + header->index_offset;
+	return 0;
+}
+
+int mesh_load(mesh_s *mesh, const char *source, const char *binary)
+{
+	struct stat st;
+	int haveSource = (stat(source, &st) == 0);
+
+	if (mesh_map(mesh, binary, haveSource ? &st : NULL) == 0) {
+		return 0;
+	}
+	if (!haveSource || mesh_import_obj(source, binary) != 0) {
+		return -1;
+	}
+	return mesh_map(mesh, binary, &st);
+}
+
+void mesh_unmap(mesh_s *mesh)
+{
+	if (mesh->map) {
+		munmap(mesh->map, mesh->size);
+	}
+	memset(mesh, 0, sizeof(*mesh));
+}
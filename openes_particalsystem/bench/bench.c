@@ -0,0 +1,312 @@
+/*
+ * bench.c
+ *
+ * Host microbenchmarks of the CPU particle kernels: initialization
+ * (particles_init, lod_init), the per-frame work of the CPU simulation
+ * (particles_reset_state, particles_simulate) and the kernels of kernels.h,
+ * each over 1k to 1M particles.
+ *
+ * Every kernel runs BENCH_RUNS times over enough repetitions to take about
+ * BENCH_PARTICLES_PER_RUN particle updates, and the best run is reported as
+ * ns per particle and as bytes per second, counting the arrays the kernel
+ * reads and writes once per particle. SIMD versions are checked against the
+ * scalar ones and reported with their speedup.
+ *
+ * Only these EFL and GL free sources are needed; from the project
+ * directory:
+ *
+ *   gcc -O2 -std=gnu99 -Iinc bench/bench.c src/particles.c src/kernels.c src/lod.c -lm -o particle_bench
+ *   ./particle_bench [max particles]
+ *
+ * Add -mfpu=neon on 32-bit ARM; without SSE2 or NEON the SIMD rows run
+ * the scalar code.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kernels.h"
+#include "lod.h"
+#include "particles.h"
+
+#define BENCH_MIN_PARTICLES 1024
+#define BENCH_MAX_PARTICLES (1024 * 1024)
+#define BENCH_PARTICLES_PER_RUN (4 * 1024 * 1024)
+#define BENCH_RUNS 5
+#define BENCH_SEED 0
+#define BENCH_TIME_STEP 0.02f
+
+typedef struct {
+	int capacity;
+	particle_rng_s rng;
+	kernel_rng_s rng4;
+	particle_force_s forces[PARTICLE_MAX_FORCES];
+	int force_count;
+	float time;
+
+	float *data;		// PARTICLE_SIZE floats per particle
+	float *state;		// PARTICLE_STATE_SIZE floats per particle
+	float *accel;		// 3 floats per particle
+	float *random;		// PARTICLE_SIZE floats per particle
+	int16_t *packed;	// 4 per particle
+	uint32_t *order;
+	uint32_t *scratch;	// 3 per particle
+	lod_s lod;
+} bench_data_s;
+
+typedef struct {
+	const char *name;
+	const char *variant;
+	size_t bytes;		// read and written per particle
+	void (*run)(bench_data_s *bench, int count);
+} bench_kernel_s;
+
+static void run_init(bench_data_s *bench, int count)
+{
+	particles_init(bench->data, count, &bench->rng);
+}
+
+static void run_lod_init(bench_data_s *bench, int count)
+{
+	lod_init(&bench->lod, bench->data, count);
+}
+
+static void run_reset(bench_data_s *bench, int count)
+{
+	static const float center[3] = { 0.1f, 0.2f, 0.0f };
+	particles_reset_state(bench->data, bench->state, count, center);
+}
+
+static void run_simulate(bench_data_s *bench, int count)
+{
+	particles_simulate(bench->state, count, bench->forces, bench->force_count, BENCH_TIME_STEP, bench->time,
+			bench->accel, NULL);
+	bench->time += BENCH_TIME_STEP;
+}
+
+static void run_rng_scalar(bench_data_s *bench, int count)
+{
+	kernel_rng_fill_scalar(&bench->rng4, bench->random, count * PARTICLE_SIZE);
+}
+
+static void run_rng_simd(bench_data_s *bench, int count)
+{
+	kernel_rng_fill_simd(&bench->rng4, bench->random, count * PARTICLE_SIZE);
+}
+
+static void run_pack_scalar(bench_data_s *bench, int count)
+{
+	kernel_pack_positions_scalar(bench->state, bench->packed, count);
+}
+
+static void run_pack_simd(bench_data_s *bench, int count)
+{
+	kernel_pack_positions_simd(bench->state, bench->packed, count);
+}
+
+static void run_sort(bench_data_s *bench, int count)
+{
+	kernel_sort_depth(bench->state, bench->order, bench->scratch, count);
+}
+
+/* A SIMD variant directly follows its scalar one */
+static const bench_kernel_s kernels[] = {
+	{ "init", "scalar", PARTICLE_SIZE * sizeof(float), run_init },
+	{ "lod_init", "scalar", PARTICLE_SIZE * sizeof(float), run_lod_init },
+	{ "reset", "scalar", (PARTICLE_SIZE + PARTICLE_STATE_SIZE) * sizeof(float), run_reset },
+	{ "simulate", "scalar", (2 * PARTICLE_STATE_SIZE + 2 * 3) * sizeof(float), run_simulate },
+	{ "rng", "scalar", PARTICLE_SIZE * sizeof(float), run_rng_scalar },
+	{ "rng", KERNELS_SIMD_NAME, PARTICLE_SIZE * sizeof(float), run_rng_simd },
+	{ "pack", "scalar", PARTICLE_STATE_SIZE * sizeof(float) + 4 * sizeof(int16_t), run_pack_scalar },
+	{ "pack", KERNELS_SIMD_NAME, PARTICLE_STATE_SIZE * sizeof(float) + 4 * sizeof(int16_t), run_pack_simd },
+	{ "sort", "scalar", PARTICLE_STATE_SIZE * sizeof(float) + sizeof(uint32_t), run_sort },
+};
+
+/*
+ * @brief The force list of the app, see init_forces() in glview.c
+ */
+static void init_forces(bench_data_s *bench)
+{
+	const particle_force_s forces[] = {
+		{ { PARTICLE_FORCE_GRAVITY, 0.6f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f, 0.0f } },
+		{ { PARTICLE_FORCE_DRAG, 0.3f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+		{ { PARTICLE_FORCE_ATTRACTOR, 0.05f, 0.2f, 0.0f }, { 0.0f, 0.3f, 0.0f, 0.0f } },
+		{ { PARTICLE_FORCE_TURBULENCE, 0.4f, 3.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+		{ { PARTICLE_COLLIDER_PLANE, 0.0f, 0.5f, 0.2f }, { 0.0f, 1.0f, 0.0f, -0.8f } },
+		{ { PARTICLE_COLLIDER_SPHERE, 0.0f, 0.6f, 0.1f }, { 0.4f, -0.5f, 0.0f, 0.2f } },
+	};
+	bench->force_count = sizeof(forces) / sizeof(forces[0]);
+	memcpy(bench->forces, forces, sizeof(forces));
+}
+
+static int bench_init(bench_data_s *bench, int capacity)
+{
+	memset(bench, 0, sizeof(*bench));
+	bench->capacity = capacity;
+	bench->data = malloc((size_t)capacity * PARTICLE_SIZE * sizeof(float));
+	bench->state = malloc((size_t)capacity * PARTICLE_STATE_SIZE * sizeof(float));
+	bench->accel = malloc((size_t)capacity * 3 * sizeof(float));
+	bench->random = malloc((size_t)capacity * PARTICLE_SIZE * sizeof(float));
+	bench->packed = malloc((size_t)capacity * 4 * sizeof(int16_t));
+	bench->order = malloc((size_t)capacity * sizeof(uint32_t));
+	bench->scratch = malloc((size_t)capacity * 3 * sizeof(uint32_t));
+	if (!bench->data || !bench->state || !bench->accel || !bench->random || !bench->packed || !bench->order ||
+			!bench->scratch) {
+		return -1;
+	}
+
+	particle_rng_seed(&bench->rng, BENCH_SEED);
+	kernel_rng_seed(&bench->rng4, BENCH_SEED);
+	init_forces(bench);
+	particles_init(bench->data, capacity, &bench->rng);
+	return 0;
+}
+
+static void bench_destroy(bench_data_s *bench)
+{
+	free(bench->data);
+	free(bench->state);
+	free(bench->accel);
+	free(bench->random);
+	free(bench->packed);
+	free(bench->order);
+	free(bench->scratch);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/*
+ * @brief Best ns per particle of <kernel> over <count> particles
+ */
+static double measure(const bench_kernel_s *kernel, bench_data_s *bench, int count)
+{
+	int repetitions = BENCH_PARTICLES_PER_RUN / count;
+	if (repetitions < 1) {
+		repetitions = 1;
+	}
+	/* Every run starts from the same particles, warmed up once */
+	static const float origin[3] = { 0.0f, 0.0f, 0.0f };
+	particles_reset_state(bench->data, bench->state, count, origin);
+	kernel->run(bench, count);
+
+	double best = 0.0;
+	for (int run = 0; run < BENCH_RUNS; ++run) {
+		particles_reset_state(bench->data, bench->state, count, origin);
+		uint64_t start = now_ns();
+		for (int r = 0; r < repetitions; ++r) {
+			kernel->run(bench, count);
+		}
+		double ns = (double)(now_ns() - start) / ((double)repetitions * count);
+		if (run == 0 || ns < best) {
+			best = ns;
+		}
+	}
+	return best;
+}
+
+/*
+ * @brief Check the SIMD kernels against the scalar ones over <count>
+ *        particles
+ * @return number of mismatching kernels
+ */
+static int verify(bench_data_s *bench, int count)
+{
+	int mismatches = 0;
+	size_t values = (size_t)count * PARTICLE_SIZE;
+
+	kernel_rng_s scalarRng, simdRng;
+	kernel_rng_seed(&scalarRng, BENCH_SEED);
+	kernel_rng_seed(&simdRng, BENCH_SEED);
+	float *expected = malloc(values * sizeof(float));
+	int16_t *packed = malloc((size_t)count * 4 * sizeof(int16_t));
+	if (!expected || !packed) {
+		free(expected);
+		free(packed);
+		return 1;
+	}
+
+	kernel_rng_fill_scalar(&scalarRng, expected, values);
+	kernel_rng_fill_simd(&simdRng, bench->random, values);
+	if (memcmp(expected, bench->random, values * sizeof(float)) != 0 ||
+			memcmp(scalarRng.state, simdRng.state, sizeof(scalarRng.state)) != 0) {
+		printf("rng: %s output differs from scalar at %d particles\n", KERNELS_SIMD_NAME, count);
+		mismatches++;
+	}
+
+	/* Simulated positions, some outside [-1, 1] to exercise the clamp */
+	static const float center[3] = { 0.5f, -0.5f, 0.25f };
+	particles_reset_state(bench->data, bench->state, count, center);
+	kernel_pack_positions_scalar(bench->state, packed, count);
+	kernel_pack_positions_simd(bench->state, bench->packed, count);
+	if (memcmp(packed, bench->packed, (size_t)count * 4 * sizeof(int16_t)) != 0) {
+		printf("pack: %s output differs from scalar at %d particles\n", KERNELS_SIMD_NAME, count);
+		mismatches++;
+	}
+
+	kernel_sort_depth(bench->state, bench->order, bench->scratch, count);
+	for (int i = 1; i < count; ++i) {
+		if (bench->state[bench->order[i - 1] * PARTICLE_STATE_SIZE + 2] <
+				bench->state[bench->order[i] * PARTICLE_STATE_SIZE + 2]) {
+			printf("sort: not back to front at %d particles\n", count);
+			mismatches++;
+			break;
+		}
+	}
+
+	free(expected);
+	free(packed);
+	return mismatches;
+}
+
+int main(int argc, char **argv)
+{
+	int maxCount = BENCH_MAX_PARTICLES;
+	if (argc > 1) {
+		maxCount = atoi(argv[1]);
+		if (maxCount < BENCH_MIN_PARTICLES) {
+			fprintf(stderr, "usage: %s [max particles, at least %d]\n", argv[0], BENCH_MIN_PARTICLES);
+			return 2;
+		}
+	}
+
+	bench_data_s bench;
+	if (bench_init(&bench, maxCount) != 0) {
+		fprintf(stderr, "out of memory for %d particles\n", maxCount);
+		bench_destroy(&bench);
+		return 1;
+	}
+
+	printf("simd: %s, %d runs of %d particle updates, best run\n", KERNELS_SIMD_NAME, BENCH_RUNS,
+			BENCH_PARTICLES_PER_RUN);
+	printf("%-10s %-7s %10s %12s %10s %8s\n", "kernel", "variant", "particles", "ns/particle", "MB/s", "speedup");
+
+	int mismatches = 0;
+	for (int count = BENCH_MIN_PARTICLES; count <= maxCount; count *= 4) {
+		mismatches += verify(&bench, count);
+
+		double scalarNs = 0.0;
+		for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+			const bench_kernel_s *kernel = &kernels[k];
+			double ns = measure(kernel, &bench, count);
+			double mbPerSecond = kernel->bytes / ns * 1e9 / (1024.0 * 1024.0);
+
+			if (strcmp(kernel->variant, "scalar") == 0) {
+				scalarNs = ns;
+				printf("%-10s %-7s %10d %12.3f %10.0f\n", kernel->name, kernel->variant, count, ns, mbPerSecond);
+			} else {
+				printf("%-10s %-7s %10d %12.3f %10.0f %7.2fx\n", kernel->name, kernel->variant, count, ns,
+						mbPerSecond, scalarNs / ns);
+			}
+		}
+	}
+
+	bench_destroy(&bench);
+	return mismatches ? 1 : 0;
+}
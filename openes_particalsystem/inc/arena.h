@@ -0,0 +1,91 @@
+/*
+ * arena.h
+ *
+ * Linear allocators for transient memory.
+ *
+ * An arena grabs one block up front and hands out aligned pieces of it by
+ * bumping an offset; everything is released at once by resetting the
+ * offset. The renderer owns a frame arena, reset at the end of every
+ * draw_glview(), and an init arena for setup scratch such as shader info
+ * logs. Nothing in here depends on EFL or GL.
+ *
+ * Code of this app that really needs the heap goes through
+ * heap_alloc()/heap_free(), which count allocations, so the frame loop can
+ * check that a steady-state frame makes none of its own. Only those calls
+ * are counted: malloc() from EFL, the GL driver or libc itself is not, so
+ * a count of 0 does not mean the frame did not touch the heap.
+ */
+
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARENA_ALIGNMENT 16
+
+typedef struct {
+	uint8_t *base;
+	size_t capacity;
+	size_t used;
+	size_t peak;		/* high-water mark of <used> */
+	uint64_t failures;	/* allocations that did not fit */
+} arena_s;
+
+/*
+ * @brief Allocate the backing block of an arena
+ * @param[in] capacity size in bytes
+ * @return 0 on success, -1 if the block could not be allocated
+ */
+int arena_init(arena_s *arena, size_t capacity);
+
+/*
+ * @brief Allocate <size> bytes, aligned to ARENA_ALIGNMENT
+ * @return the memory, NULL if the arena is full
+ */
+void *arena_alloc(arena_s *arena, size_t size);
+
+/*
+ * @brief Current offset, to release everything allocated after it with
+ *        arena_release()
+ */
+static inline size_t arena_mark(const arena_s *arena)
+{
+	return arena->used;
+}
+
+/*
+ * @brief Release everything allocated since <mark>
+ */
+static inline void arena_release(arena_s *arena, size_t mark)
+{
+	if (mark < arena->used) {
+		arena->used = mark;
+	}
+}
+
+/*
+ * @brief Release everything
+ */
+static inline void arena_reset(arena_s *arena)
+{
+	arena->used = 0;
+}
+
+/*
+ * @brief Free the backing block
+ */
+void arena_destroy(arena_s *arena);
+
+/*
+ * @brief malloc()/free() counted by heap_alloc_count()
+ */
+void *heap_alloc(size_t size);
+void heap_free(void *pointer);
+
+/*
+ * @brief Number of heap_alloc() calls so far; other heap use is not seen
+ */
+uint64_t heap_alloc_count(void);
+
+#endif /* ARENA_H_ */
@@ -0,0 +1,219 @@
+/*
+ * capture.h
+ *
+ * Record and replay of the GL command stream.
+ *
+ * While a capture is running, the Evas GL API table used by the GL macros
+ * is swapped with a recording copy, so every call issued by init_glview()
+ * and draw_glview() is forwarded to the driver and appended to a binary
+ * file in the app data directory. Client-side vertex arrays are resolved
+ * at draw time, so the file holds the exact attribute data and uniform
+ * values that were submitted.
+ *
+ * Build with -DCAPTURE_FRAMES=<n> (USER_DEFS in project_def.prop) to record
+ * the first <n> frames into capture.glcp, or with -DCAPTURE_REPLAY to run
+ * a recorded capture.glcp instead of the particle system and log per-frame
+ * timings and per-call counts.
+ */
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <Elementary.h>
+
+#define CAPTURE_FILE_NAME "capture.glcp"
+#define CAPTURE_MAGIC 0x50434c47 /* "GLCP" */
+#define CAPTURE_VERSION 5
+#define CAPTURE_MAX_ATTRIBS 16
+#define CAPTURE_MAX_NAMES 1024
+#define CAPTURE_MAX_UNIFORMS 256
+#define CAPTURE_MAX_VARYINGS 16
+
+typedef enum {
+	CAPTURE_OP_CREATE_SHADER = 1,
+	CAPTURE_OP_SHADER_SOURCE,
+	CAPTURE_OP_COMPILE_SHADER,
+	CAPTURE_OP_DELETE_SHADER,
+	CAPTURE_OP_CREATE_PROGRAM,
+	CAPTURE_OP_ATTACH_SHADER,
+	CAPTURE_OP_LINK_PROGRAM,
+	CAPTURE_OP_DELETE_PROGRAM,
+	CAPTURE_OP_GET_UNIFORM_LOCATION,
+	CAPTURE_OP_USE_PROGRAM,
+	CAPTURE_OP_UNIFORM1F,
+	CAPTURE_OP_UNIFORM1I,
+	CAPTURE_OP_UNIFORM3FV,
+	CAPTURE_OP_UNIFORM4FV,
+	CAPTURE_OP_CLEAR_COLOR,
+	CAPTURE_OP_CLEAR,
+	CAPTURE_OP_VIEWPORT,
+	CAPTURE_OP_ENABLE,
+	CAPTURE_OP_DISABLE,
+	CAPTURE_OP_BLEND_FUNC,
+	CAPTURE_OP_ENABLE_VERTEX_ATTRIB_ARRAY,
+	CAPTURE_OP_DISABLE_VERTEX_ATTRIB_ARRAY,
+	CAPTURE_OP_VERTEX_ATTRIB_POINTER,
+	CAPTURE_OP_CLIENT_ATTRIB,
+	CAPTURE_OP_GEN_BUFFERS,
+	CAPTURE_OP_DELETE_BUFFERS,
+	CAPTURE_OP_BIND_BUFFER,
+	CAPTURE_OP_BUFFER_DATA,
+	CAPTURE_OP_BUFFER_SUB_DATA,
+	CAPTURE_OP_DRAW_ARRAYS,
+	CAPTURE_OP_DRAW_ELEMENTS,
+	CAPTURE_OP_FLUSH,
+	CAPTURE_OP_FRAME_BEGIN,
+	CAPTURE_OP_FRAME_END,
+	CAPTURE_OP_END,
+	CAPTURE_OP_GET_UNIFORM_BLOCK_INDEX,
+	CAPTURE_OP_UNIFORM_BLOCK_BINDING,
+	CAPTURE_OP_BIND_BUFFER_RANGE,
+	CAPTURE_OP_TRANSFORM_FEEDBACK_VARYINGS,
+	CAPTURE_OP_BEGIN_TRANSFORM_FEEDBACK,
+	CAPTURE_OP_END_TRANSFORM_FEEDBACK,
+	CAPTURE_OP_BIND_BUFFER_BASE,
+	CAPTURE_OP_GEN_TEXTURES,
+	CAPTURE_OP_DELETE_TEXTURES,
+	CAPTURE_OP_BIND_TEXTURE,
+	CAPTURE_OP_TEX_STORAGE_2D,
+	CAPTURE_OP_TEX_PARAMETERI,
+	CAPTURE_OP_GEN_FRAMEBUFFERS,
+	CAPTURE_OP_DELETE_FRAMEBUFFERS,
+	CAPTURE_OP_BIND_FRAMEBUFFER,
+	CAPTURE_OP_FRAMEBUFFER_TEXTURE_2D,
+	CAPTURE_OP_BLIT_FRAMEBUFFER,
+	CAPTURE_OP_COPY_BUFFER_SUB_DATA,
+	CAPTURE_OP_ACTIVE_TEXTURE,
+	CAPTURE_OP_DEPTH_FUNC,
+	CAPTURE_OP_DEPTH_MASK,
+	CAPTURE_OP_COUNT
+} capture_op_e;
+
+/*
+ * File layout: a capture_file_header_s followed by records. Each record is
+ * a capture_record_header_s, <words> 32-bit arguments (GLenum, GLint, GLuint
+ * and GLfloat bit patterns) and <size> bytes of trailing data (strings,
+ * uniform arrays, buffer contents, client vertex data). Records are 4-byte
+ * aligned so trailing data can be handed to GL straight from the mapping.
+ * Everything before the first FRAME_BEGIN is setup (shaders, programs,
+ * static buffers); the END record carries the per-op call counts, one per
+ * op, so CAPTURE_VERSION goes up whenever an op is added.
+ * Writes through glMapBufferRange() are recorded as BUFFER_SUB_DATA when the
+ * buffer is unmapped.
+ */
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t frames;
+	uint32_t reserved;
+} capture_file_header_s;
+
+typedef struct {
+	uint16_t op;
+	uint16_t words;
+	uint32_t size;
+} capture_record_header_s;
+
+typedef struct {
+	Eina_Bool enabled;
+	Eina_Bool client;
+	const void *pointer;
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLsizei stride;
+} capture_attrib_s;
+
+typedef struct {
+	GLenum target;
+	GLintptr offset;
+	GLsizeiptr length;
+	void *pointer;
+} capture_mapping_s;
+
+typedef struct {
+	FILE *file;
+	Evas_GL_API *real;
+	Eina_Bool active;
+	int frame;
+	int frame_limit;
+	GLuint array_buffer;
+	capture_attrib_s attribs[CAPTURE_MAX_ATTRIBS];
+	capture_mapping_s mapping;
+	uint32_t counts[CAPTURE_OP_COUNT];
+} capture_s;
+
+typedef struct {
+	GLuint program;
+	GLint from;
+	GLint to;
+} replay_uniform_s;
+
+typedef struct {
+	unsigned char *map;
+	size_t map_size;
+	size_t setup_end;
+	size_t cursor;
+	Eina_Bool active;
+	GLuint names[CAPTURE_MAX_NAMES];
+	GLuint buffers[CAPTURE_MAX_NAMES];
+	GLuint textures[CAPTURE_MAX_NAMES];
+	GLuint framebuffers[CAPTURE_MAX_NAMES];
+	replay_uniform_s uniforms[CAPTURE_MAX_UNIFORMS];
+	int uniform_count;
+	replay_uniform_s blocks[CAPTURE_MAX_UNIFORMS];
+	int block_count;
+	GLuint program;
+	uint32_t counts[CAPTURE_OP_COUNT];
+	int frames;
+	double total_ms, min_ms, max_ms;
+} replay_s;
+
+/*
+ * @brief Start recording every GL call into <path>
+ * @param[in] cap capture state
+ * @param[in] path output file
+ * @param[in] frames number of frames to record before stopping
+ * @return EINA_TRUE on success
+ */
+Eina_Bool capture_begin(capture_s *cap, const char *path, int frames);
+
+/*
+ * @brief Mark the start of a frame
+ */
+void capture_frame_begin(capture_s *cap);
+
+/*
+ * @brief Mark the end of a frame; stops the capture after the frame limit
+ */
+void capture_frame_end(capture_s *cap);
+
+/*
+ * @brief Stop recording, write the call counts and restore the GL API table
+ */
+void capture_end(capture_s *cap);
+
+/*
+ * @brief Map a capture file and run its setup records
+ * @return EINA_TRUE on success
+ */
+Eina_Bool replay_open(replay_s *rp, const char *path);
+
+/*
+ * @brief Replay one recorded frame, wrapping around at the end of the file
+ */
+void replay_frame(replay_s *rp);
+
+/*
+ * @brief Release the mapping and the objects created by the replay
+ */
+void replay_close(replay_s *rp);
+
+/*
+ * @brief Name of a capture op, for logging
+ */
+const char *capture_op_name(capture_op_e op);
+
+#endif /* CAPTURE_H_ */
@@ -0,0 +1,59 @@
+/*
+ * cmdlist.h
+ *
+ * Deferred GL command lists.
+ *
+ * Jobs running off the GL thread record the GL work they need as plain
+ * structs; the GL thread submits the lists of a frame in one pass once the
+ * jobs are done. Data referenced by a command (e.g. buffer contents) must
+ * stay valid until the list is submitted.
+ */
+
+#ifndef CMDLIST_H_
+#define CMDLIST_H_
+
+#include <Elementary.h>
+
+typedef enum {
+	CMD_BUFFER_SUB_DATA,
+	CMD_BIND_BUFFER_RANGE,
+	CMD_DRAW_ARRAYS,
+} cmd_op_e;
+
+typedef struct {
+	cmd_op_e op;
+	GLenum target;		/* buffer target, or primitive mode for draws */
+	GLuint buffer;
+	GLuint index;		/* binding point of CMD_BIND_BUFFER_RANGE */
+	GLintptr offset;
+	GLsizeiptr size;
+	const void *data;
+	GLint first;
+	GLsizei count;
+} cmd_s;
+
+typedef struct {
+	cmd_s *commands;
+	int count;
+	int capacity;
+	int dropped;		/* commands that did not fit */
+} cmdlist_s;
+
+/*
+ * @brief Start an empty list recording into caller owned storage
+ */
+void cmdlist_init(cmdlist_s *list, cmd_s *storage, int capacity);
+
+void cmdlist_buffer_sub_data(cmdlist_s *list, GLenum target, GLuint buffer, GLintptr offset, GLsizeiptr size,
+		const void *data);
+void cmdlist_bind_buffer_range(cmdlist_s *list, GLenum target, GLuint index, GLuint buffer, GLintptr offset,
+		GLsizeiptr size);
+void cmdlist_draw_arrays(cmdlist_s *list, GLenum mode, GLint first, GLsizei count);
+
+/*
+ * @brief Execute lists in order. GL thread only.
+ * @return number of commands executed
+ */
+int cmdlist_submit(const cmdlist_s *lists, int listCount);
+
+#endif /* CMDLIST_H_ */
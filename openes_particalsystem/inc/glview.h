@@ -13,4 +13,21 @@
 
 void create_glview(appdata_s *ad);
 
+/*
+ * @brief Request a redraw for <flags> (dirty_flags_e), waking the animator
+ *        if it is frozen
+ */
+void glview_mark_dirty(appdata_s *ad, unsigned int flags);
+
+/*
+ * @brief Stop drawing while the app is hidden, redraw when it is shown
+ */
+void glview_set_paused(appdata_s *ad, Eina_Bool paused);
+
+/*
+ * @brief Write the last known particle state to the snapshot file, on a
+ *        thread. Needs no GL context.
+ */
+void glview_save_snapshot(appdata_s *ad);
+
 #endif /* GLVIEW_C_ */
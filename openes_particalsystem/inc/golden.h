@@ -0,0 +1,62 @@
+/*
+ * golden.h
+ *
+ * Golden image comparison for the deterministic simulation mode.
+ *
+ * A golden image is a raw RGBA8 dump of the framebuffer after a fixed
+ * number of deterministic frames, prefixed with a golden_header_s. Images
+ * are looked up by framebuffer size, e.g. golden_720x1280.rgba, because a
+ * frame is only comparable against one rendered at the same size.
+ */
+
+#ifndef GOLDEN_H_
+#define GOLDEN_H_
+
+#include <stdint.h>
+
+#define GOLDEN_MAGIC 0x444c4f47 /* "GOLD" */
+
+typedef struct {
+	uint32_t magic;
+	uint32_t width;
+	uint32_t height;
+	uint32_t reserved;
+} golden_header_s;
+
+typedef enum {
+	GOLDEN_PASS,
+	GOLDEN_FAIL,
+	GOLDEN_MISSING,
+} golden_result_e;
+
+typedef struct {
+	golden_result_e result;
+	int bad_pixels;		/* pixels with any channel off by more than the tolerance */
+	int max_diff;		/* largest channel difference seen */
+} golden_report_s;
+
+/*
+ * @brief Build the golden image file name for a framebuffer size
+ */
+void golden_file_name(char *name, int size, int width, int height);
+
+/*
+ * @brief Compare RGBA8 pixels against a golden image
+ * @param[in] path golden image
+ * @param[in] pixels framebuffer contents, bottom row first as glReadPixels returns them
+ * @param[in] width framebuffer width
+ * @param[in] height framebuffer height
+ * @param[in] tolerance allowed difference per channel
+ * @param[in] max_bad_ratio allowed fraction of pixels over the tolerance
+ * @param[out] report outcome of the comparison
+ */
+void golden_compare(const char *path, const uint8_t *pixels, int width, int height,
+		int tolerance, float max_bad_ratio, golden_report_s *report);
+
+/*
+ * @brief Write RGBA8 pixels as a golden image
+ * @return 0 on success
+ */
+int golden_write(const char *path, const uint8_t *pixels, int width, int height);
+
+#endif /* GOLDEN_H_ */
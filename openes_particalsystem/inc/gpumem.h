@@ -0,0 +1,161 @@
+/*
+ * gpumem.h
+ *
+ * GPU memory registry.
+ *
+ * Every GL object the renderer creates is registered with its byte size:
+ * the size given to glBufferData() for buffers, the program binary length
+ * for programs, width * height * bytes per pixel for textures and
+ * renderbuffers. The registry keeps the totals per kind and overall, and
+ * keeps the total under a budget by evicting least recently used entries.
+ *
+ * Only entries registered with an evict callback are evictable: caches
+ * whose content can be rebuilt (program binaries, atlases, offscreen
+ * targets). Evicting calls the callback, which must delete the GL object;
+ * the entry is dropped afterwards. Everything else is pinned and only
+ * counted.
+ *
+ * The budget covers caches and the renderer's own objects. The view-sized
+ * render target the frame draws into is reserved on top of it with
+ * gpumem_reserve(), so the limit scales with the view: a QHD target alone
+ * is larger than the default budget, and counting it would leave nothing
+ * for programs and buffers.
+ *
+ * Registering never evicts anything. The budget is enforced once per
+ * frame by gpumem_apply(), which only evicts entries the previous frame did
+ * not touch: what a frame uses is likely used again by the next one, and
+ * evicting it would only rebuild it. If the pinned entries and the ones in
+ * use add up to more than the budget, nothing is evicted and a warning is
+ * logged instead.
+ *
+ * GL objects may only be deleted while the context is current, so low
+ * memory notifications just request a trim that the next frame applies.
+ */
+
+#ifndef GPUMEM_H_
+#define GPUMEM_H_
+
+#include <Elementary.h>
+#include <stdint.h>
+
+#define GPUMEM_MAX_ENTRIES 256
+
+#ifndef GPUMEM_BUDGET
+#define GPUMEM_BUDGET (32 * 1024 * 1024)
+#endif
+
+typedef enum {
+	GPUMEM_BUFFER,
+	GPUMEM_PROGRAM,
+	GPUMEM_TEXTURE,
+	GPUMEM_RENDERBUFFER,
+	GPUMEM_KIND_COUNT
+} gpumem_kind_e;
+
+/*
+ * @brief Delete an evicted GL object
+ */
+typedef void (*gpumem_evict_cb)(void *data, GLuint name);
+
+typedef struct {
+	gpumem_kind_e kind;
+	GLuint name;
+	size_t bytes;
+	const char *label;	/* static string, for reports */
+	uint64_t last_use;
+	gpumem_evict_cb evict;	/* NULL when pinned */
+	void *evict_data;
+} gpumem_entry_s;
+
+typedef struct {
+	gpumem_entry_s entries[GPUMEM_MAX_ENTRIES];
+	int count;
+
+	size_t budget;
+	size_t reserved;	/* on top of the budget, see gpumem_reserve() */
+	size_t total;
+	size_t peak;
+	size_t by_kind[GPUMEM_KIND_COUNT];
+	uint64_t clock;		/* advanced by every touch */
+	uint64_t frame_clock;	/* clock at the last gpumem_apply(), later uses are in use */
+	Eina_Bool over_budget;	/* in use alone is over the budget, warned once */
+	uint64_t evictions;
+	size_t evicted_bytes;
+
+	size_t trim_target;	/* requested trim, SIZE_MAX when none */
+} gpumem_s;
+
+/*
+ * @brief Start an empty registry
+ * @param[in] budget bytes the total should stay under
+ */
+void gpumem_init(gpumem_s *gm, size_t budget);
+
+/*
+ * @brief Raise the limit to the budget plus <bytes>, replacing the last
+ *        reservation; for the pinned render target of the current view
+ */
+void gpumem_reserve(gpumem_s *gm, size_t bytes);
+
+/*
+ * @brief Bytes the total should stay under: budget plus reservation
+ */
+size_t gpumem_limit(const gpumem_s *gm);
+
+/*
+ * @brief Register a GL object; it counts as in use until the frame after
+ *        next, so the budget never evicts it right away
+ * @param[in] label static description for reports
+ * @param[in] evict callback deleting the object, NULL to pin it
+ * @return EINA_TRUE if the object is registered
+ */
+Eina_Bool gpumem_track(gpumem_s *gm, gpumem_kind_e kind, GLuint name, size_t bytes, const char *label,
+		gpumem_evict_cb evict, void *evictData);
+
+/*
+ * @brief Register a program, sized by its binary length
+ */
+Eina_Bool gpumem_track_program(gpumem_s *gm, GLuint program, const char *label);
+
+/*
+ * @brief Change the size of a registered object, e.g. after glBufferData()
+ */
+void gpumem_resize(gpumem_s *gm, gpumem_kind_e kind, GLuint name, size_t bytes);
+
+/*
+ * @brief Mark an object as used now
+ */
+void gpumem_touch(gpumem_s *gm, gpumem_kind_e kind, GLuint name);
+
+/*
+ * @brief Forget an object the caller is deleting
+ */
+void gpumem_untrack(gpumem_s *gm, gpumem_kind_e kind, GLuint name);
+
+/*
+ * @brief Evict least recently used evictable objects until the total is at
+ *        most <target>, in use or not, e.g. before deleting the context.
+ *        The context must be current.
+ * @return bytes freed
+ */
+size_t gpumem_trim(gpumem_s *gm, size_t target);
+
+/*
+ * @brief Ask the next gpumem_apply() to trim to <target>; safe without a
+ *        current context
+ */
+void gpumem_request_trim(gpumem_s *gm, size_t target);
+
+/*
+ * @brief Start a frame: run a requested trim, else trim to the limit, in
+ *        both cases only evicting objects the last frame did not use. Call
+ *        once per frame with the context current, before drawing.
+ */
+void gpumem_apply(gpumem_s *gm);
+
+/*
+ * @brief Log totals, per kind sizes and the largest objects
+ */
+void gpumem_report(const gpumem_s *gm);
+
+#endif /* GPUMEM_H_ */
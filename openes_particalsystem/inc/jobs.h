@@ -0,0 +1,100 @@
+/*
+ * jobs.h
+ *
+ * Work-stealing job system.
+ *
+ * Every thread taking part owns a Chase-Lev deque: it pushes and pops jobs
+ * at the bottom, idle threads steal from the top. The thread calling
+ * jobs_init() is thread 0; it submits the frame's jobs and helps running
+ * them in jobs_wait() instead of blocking. Workers with nothing to steal
+ * sleep until new jobs are submitted.
+ *
+ * Jobs must not call GL: the context belongs to the thread running the
+ * GLView callbacks. Jobs record what they need into a command list (see
+ * cmdlist.h) that the GL thread submits once they are done. Job storage is
+ * owned by the caller, typically the frame arena, and must stay valid
+ * until jobs_wait() returns. Nothing in here depends on EFL or GL.
+ */
+
+#ifndef JOBS_H_
+#define JOBS_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define JOBS_MAX_THREADS 8
+#define JOBS_DEQUE_SIZE 256	/* jobs in flight per thread, power of two */
+
+struct job;
+
+typedef void (*job_func)(void *data, int thread);
+
+/*
+ * Number of jobs still to finish. Zero the counter before submitting.
+ */
+typedef struct {
+	atomic_int pending;
+} job_counter_s;
+
+typedef struct job {
+	job_func func;
+	void *data;
+	job_counter_s *counter;
+} job_s;
+
+typedef struct {
+	atomic_long top;
+	atomic_long bottom;
+	_Atomic(job_s *) jobs[JOBS_DEQUE_SIZE];
+} job_deque_s;
+
+struct job_system;
+
+typedef struct {
+	struct job_system *js;
+	int index;
+} job_worker_s;
+
+typedef struct job_system {
+	int thread_count;	/* worker threads + the submitting thread */
+	pthread_t threads[JOBS_MAX_THREADS];
+	job_worker_s workers[JOBS_MAX_THREADS];
+	job_deque_s deques[JOBS_MAX_THREADS];
+
+	atomic_int running;
+	atomic_int queued;	/* jobs pushed and not taken yet */
+	atomic_int sleepers;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+
+	/* counters, reset by the caller */
+	atomic_int executed[JOBS_MAX_THREADS];
+	atomic_int stolen;
+} job_system_s;
+
+/*
+ * @brief Start the workers
+ * @param[in] threads total thread count including the caller, 0 for one
+ *            per online core
+ * @return 0 on success, -1 if no worker could be started (jobs then run on
+ *         the calling thread)
+ */
+int jobs_init(job_system_s *js, int threads);
+
+/*
+ * @brief Queue a job on the calling thread's deque. Runs it right away if
+ *        the deque is full.
+ */
+void jobs_submit(job_system_s *js, job_s *job, job_counter_s *counter);
+
+/*
+ * @brief Run and steal jobs until every job of <counter> has finished
+ */
+void jobs_wait(job_system_s *js, job_counter_s *counter);
+
+/*
+ * @brief Stop and join the workers. Queued jobs must have been waited for.
+ */
+void jobs_shutdown(job_system_s *js);
+
+#endif /* JOBS_H_ */
@@ -0,0 +1,73 @@
+/*
+ * kernels.h
+ *
+ * CPU kernels over whole particle arrays: random numbers, packing of the
+ * simulated positions for upload, and depth sorting.
+ *
+ * Each kernel with a SIMD version has a _scalar and a _simd entry point;
+ * the SIMD one is SSE2 on x86 and NEON on ARM and falls back to the scalar
+ * code elsewhere (KERNELS_SIMD is then 0). Both give the same results:
+ * the random streams are the same, and packing rounds the same way except
+ * on exact ties on 32-bit ARM, which rounds them away from zero.
+ *
+ * Nothing in here depends on EFL or GL; bench/ measures the kernels on the
+ * host.
+ */
+
+#ifndef KERNELS_H_
+#define KERNELS_H_
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#define KERNELS_SIMD 1
+#define KERNELS_SIMD_NAME "sse2"
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define KERNELS_SIMD 1
+#define KERNELS_SIMD_NAME "neon"
+#else
+#define KERNELS_SIMD 0
+#define KERNELS_SIMD_NAME "none"
+#endif
+
+#define KERNEL_RNG_LANES 4
+
+/*
+ * Four xorshift32 streams, one per SIMD lane; value i of a fill comes from
+ * stream i % KERNEL_RNG_LANES
+ */
+typedef struct {
+	uint32_t state[KERNEL_RNG_LANES];
+} kernel_rng_s;
+
+/*
+ * @brief Seed the streams from one seed, each differently
+ */
+void kernel_rng_seed(kernel_rng_s *rng, uint32_t seed);
+
+/*
+ * @brief Fill <count> floats in [0, 1), <count> a multiple of
+ *        KERNEL_RNG_LANES
+ */
+void kernel_rng_fill_scalar(kernel_rng_s *rng, float *out, int count);
+void kernel_rng_fill_simd(kernel_rng_s *rng, float *out, int count);
+
+/*
+ * @brief Pack the positions of <count> particles of simulated state into
+ *        4 snorm16 values each (x, y, z, 0), clamped to [-1, 1]
+ * @param[in] state PARTICLE_STATE_SIZE floats per particle
+ * @param[out] packed 4 values per particle
+ */
+void kernel_pack_positions_scalar(const float *state, int16_t *packed, int count);
+void kernel_pack_positions_simd(const float *state, int16_t *packed, int count);
+
+/*
+ * @brief Order particles back to front (largest z first) with a stable
+ *        LSD radix sort of their depth
+ * @param[in] state PARTICLE_STATE_SIZE floats per particle
+ * @param[out] order particle indices
+ * @param[out] scratch 3 * <count> entries, clobbered
+ */
+void kernel_sort_depth(const float *state, uint32_t *order, uint32_t *scratch, int count);
+
+#endif /* KERNELS_H_ */
@@ -0,0 +1,87 @@
+/*
+ * lod.h
+ *
+ * Level of detail of the particle draw, picked per emitter from its screen
+ * coverage: the part of the emitter's footprint that lands in the viewport,
+ * in pixels.
+ *
+ * Fill rate is what particles cost, so an emitter draws about one particle
+ * per LOD_PIXELS_PER_PARTICLE covered pixels, up to its capacity. The
+ * particle data is in random order, so drawing the first <count> particles
+ * is a random subset. The count moves smoothly towards its target and the
+ * last LOD_FADE_PARTICLES drawn particles fade out, so thinning never pops;
+ * a fully drawn emitter has its fade band past its last particle.
+ * Point sizes follow the viewport, not the emitter: the scene is drawn in
+ * NDC without perspective, so every emitter's particles are the same size
+ * on screen. The switch to the shader without the circular discard is
+ * therefore a viewport-level one that all emitters take together, below a
+ * shorter side of LOD_REFERENCE_SIZE * LOD_CHEAP_POINT_SIZE / LOD_POINT_SIZE
+ * (216 pixels, watch-sized views). It is kept per emitter so that a
+ * depth-dependent size can slot in.
+ *
+ * Nothing in here depends on EFL or GL.
+ */
+
+#ifndef LOD_H_
+#define LOD_H_
+
+#define LOD_PIXELS_PER_PARTICLE 256.0f
+#define LOD_FADE_PARTICLES 64.0f
+#define LOD_RATE 2.0f		/* capacity fraction the count moves per second */
+#define LOD_MAX_ALPHA_SCALE 2.0f	/* brightness kept when thinning, additive blending */
+
+#define LOD_POINT_SIZE 40.0f	/* largest point size at the reference viewport */
+#define LOD_REFERENCE_SIZE 720.0f	/* shorter viewport side the point size is tuned for */
+#define LOD_CHEAP_POINT_SIZE 12.0f	/* below this many pixels the discard is not worth it */
+#define LOD_CHEAP_HYSTERESIS 2.0f
+
+#define LOD_REPORT_FRAMES 300
+
+typedef struct {
+	float radius;		/* footprint radius around the center, in NDC */
+	int capacity;
+
+	float coverage;		/* visible footprint in pixels */
+	float target;		/* count the coverage asks for, fade band included */
+	float count;		/* smoothed target, < 0 before the first update */
+	float point_scale;	/* point size multiplier, from the viewport only */
+	int cheap;		/* draw without the discard, from the viewport only */
+} lod_s;
+
+/*
+ * Values of the u_lod uniform: count, fade band, point scale, alpha scale
+ */
+typedef float lod_uniform_t[4];
+
+/*
+ * @brief Set up an emitter's LOD
+ * @param[in] data particle vertex data, PARTICLE_SIZE floats per particle
+ * @param[in] capacity number of particles
+ */
+void lod_init(lod_s *lod, const float *data, int capacity);
+
+/*
+ * @brief Pick the LOD for this frame
+ * @param[in] center emitter center, in NDC
+ * @param[in] width, height viewport size in pixels
+ * @param[in] dt time step, 0 snaps to the target
+ */
+void lod_update(lod_s *lod, const float center[3], float width, float height, float dt);
+
+/*
+ * @brief Number of particles to draw, fading ones included
+ */
+int lod_draw_count(const lod_s *lod);
+
+/*
+ * @brief Whether any drawn particle is in the fade band, i.e. the draw
+ *        needs the fading shader
+ */
+int lod_fading(const lod_s *lod);
+
+/*
+ * @brief Fill the u_lod uniform
+ */
+void lod_uniform(const lod_s *lod, lod_uniform_t uniform);
+
+#endif /* LOD_H_ */
@@ -7,6 +7,18 @@
 #include <efl_extension.h>
 #include <dlog.h>
 
+#include "arena.h"
+#include "capture.h"
+#include "gpumem.h"
+#include "jobs.h"
+#include "lod.h"
+#include "particles.h"
+#include "rtpool.h"
+#include "scene.h"
+#include "snapshot.h"
+#include "ubo.h"
+#include "variants.h"
+
 #ifdef  LOG_TAG
 #undef  LOG_TAG
 #endif
@@ -17,26 +29,190 @@
 #endif
 
 #define NUM_PARTICLES 1000
-#define PARTICLE_SIZE 7
+#define NUM_EMITTERS 1
+
+/*
+ * Every frame advances the simulation by PARTICLE_TIME_STEP seconds and all
+ * randomness comes from appdata_s::rng seeded with PARTICLE_SEED.
+ *
+ * Build with -DPARTICLE_DETERMINISTIC to stop the simulation after
+ * PARTICLE_DETERMINISTIC_FRAMES frames, so the same build always ends on the
+ * same image. -DPARTICLE_GOLDEN_TEST additionally compares that frame with
+ * the golden image for the view size (see golden.h) and exits.
+ */
+#define PARTICLE_SEED 0
+#define PARTICLE_TIME_STEP 0.02f
+
+#if defined(PARTICLE_GOLDEN_TEST) && !defined(PARTICLE_DETERMINISTIC)
+#define PARTICLE_DETERMINISTIC
+#endif
+#define PARTICLE_DETERMINISTIC_FRAMES 75
+#define PARTICLE_GOLDEN_TOLERANCE 8
+#define PARTICLE_GOLDEN_MAX_BAD_RATIO 0.002f
+
+/*
+ * Transient memory, see arena.h. Arena peaks and the heap_alloc() calls
+ * made by steady-state frames are logged every ARENA_REPORT_FRAMES frames;
+ * the first ARENA_WARMUP_FRAMES frames after init are not counted.
+ */
+#define FRAME_ARENA_SIZE (64 * 1024)
+#define INIT_ARENA_SIZE (16 * 1024)
+#define ARENA_REPORT_FRAMES 300
+#define ARENA_WARMUP_FRAMES 2
+
+/*
+ * GPU memory, see gpumem.h. The budget can be overridden with
+ * -DGPUMEM_BUDGET=<bytes>. A soft low memory warning trims evictable GL
+ * objects to half the budget, a hard one evicts all of them that the last
+ * frame did not use.
+ */
+#define GPUMEM_REPORT_FRAMES 300
+
+/*
+ * Resizes and rotations keep the GL surface (ELM_GLVIEW_RESIZE_POLICY_SCALE):
+ * the scene is drawn into a pooled offscreen target of the view size and
+ * scaled onto the surface, see rtpool.h. Build with -DGLVIEW_RESIZE_RECREATE
+ * to recreate the surface on every resize and draw into it directly.
+ */
+#define RTPOOL_REPORT_FRAMES 300
+
+/*
+ * The particle state is saved to SNAPSHOT_FILE_NAME in the data directory
+ * when the app is paused, and restored from it when the view is created
+ * (see snapshot.h). The CPU path saves its current state; the GPU path
+ * saves the last readback, started every SNAPSHOT_READBACK_FRAMES frames and
+ * picked up once its fence has signalled. Deterministic builds neither save
+ * nor restore.
+ */
+#define SNAPSHOT_FILE_NAME "particles.snap"
+#define SNAPSHOT_READBACK_FRAMES 60
+
+/*
+ * Programs are shader variants, see variants.h. The draw program has the
+ * features below, picked per emitter from its LOD; all of them are built
+ * while loading. The update program has a feature per force type in the
+ * force list, see simulation.h. The cache is logged every
+ * VARIANTS_REPORT_FRAMES frames.
+ */
+typedef enum {
+	DRAW_ROUND_POINTS = 1 << 0,	// circular points, discards the corners
+	DRAW_LOD_FADE = 1 << 1,	// the emitter is thinned, its last particles fade
+	DRAW_LOD_MASK = DRAW_ROUND_POINTS | DRAW_LOD_FADE,
+	DRAW_SOFT = 1 << 2,	// depth tested and faded against the scene depth
+} draw_features_e;
+
+#define VARIANTS_REPORT_FRAMES 300
+
+/*
+ * Build with -DPARTICLE_SOFT for the depth-aware particle mode: the
+ * colliders are drawn as opaque geometry (see scene.h) after a depth
+ * pre-pass, and particles are depth tested against them, fade out over
+ * PARTICLE_SOFT_DISTANCE (in NDC) in front of them, and are dropped in the
+ * vertex shader when the scene hides them. The mode needs the offscreen
+ * targets, so GLVIEW_RESIZE_RECREATE builds draw plain particles. The
+ * golden images are of the plain mode.
+ */
+#define PARTICLE_SOFT_DISTANCE 0.1f
+
+#if defined(PARTICLE_SOFT) && defined(GLVIEW_RESIZE_RECREATE)
+#undef PARTICLE_SOFT
+#endif
+
+/*
+ * Frames are only drawn when the scene changed since the last one. Whatever
+ * changes it calls glview_mark_dirty(); the animator freezes itself on the
+ * first tick that finds nothing dirty and is thawed by the next change.
+ * While simulated time advances every frame leaves the next one dirty, so
+ * the particle view only goes idle once a deterministic build holds its
+ * last frame. While the app is paused the animator stays frozen and
+ * changes are only collected.
+ */
+typedef enum {
+	DIRTY_EMITTERS = 1 << 0,	// simulated time advanced: emitters and particles moved
+	DIRTY_UNIFORMS = 1 << 1,	// forces or other uniform block contents changed
+	DIRTY_VIEW = 1 << 2,	// new surface or size
+	DIRTY_GPUMEM = 1 << 3,	// a memory trim waits for the context
+	DIRTY_REPLAY = 1 << 4,	// replaying a capture, every frame differs
+} dirty_flags_e;
+
+/*
+ * An emitter replays the shared particle data as bursts: every second it
+ * restarts at a new random center with a new color.
+ */
+typedef struct {
+	float center[3];
+	float color[4];
+	float time;	// seconds since the current burst started
+	Eina_Bool burst;	// the burst restarted this frame
+	lod_s lod;	// particles drawn and shader, from the screen coverage
+} emitter_s;
+
+#include "simulation.h"
+
+/*
+ * Scene state that goes with a copy of the simulated particle state
+ */
+typedef struct {
+	snapshot_emitter_s emitters[NUM_EMITTERS];
+	float time;
+	particle_rng_s rng;
+	int frame;
+} scene_state_s;
 
 typedef struct appdata {
 	Evas_Object *win;
 	Evas_Object *conform;
 	Evas_Object *glview;
 	Ecore_Animator *ani;
-	int glview_h, glview_w;
+	Eina_Bool ani_frozen;
+	Eina_Bool paused;	// hidden, nothing is drawn
+	unsigned int dirty;	// dirty_flags_e to redraw for
+	int glview_h, glview_w;	// size of the view, what the scene is drawn at
+	int surface_h, surface_w;	// size of the GL surface
 
 	/* GL related data here... */
-	GLuint program;
-	GLuint vbo;    // vertex buffer object
+	variants_s shaders;	// compiled programs, by feature set
+	GLuint vbo;    // vertex buffer object, static particle data
+
+	// per-frame and per-emitter uniform blocks
+	ubo_ring_s ubo;
+	emitter_s emitters[NUM_EMITTERS];
 
-	GLint centerPositionLoc;
-	GLint colorLoc;
-	GLint timeLoc;
+	// forces, colliders and the simulated particle state
+	simulation_s sim;
+	scene_s scene;	// opaque collider geometry, PARTICLE_SOFT only
 
 	// particel vertex data
 	float particleData[NUM_PARTICLES * PARTICLE_SIZE];
-	float time;
+	float time;	// total simulated time
+	particle_rng_s rng;
+	int frame;
+	int first_frame;	// frame init_glview() started at, past 0 after a restore
+
+	// transient allocations: reset every frame / kept until the view is deleted
+	arena_s frame_arena;
+	arena_s init_arena;
+	uint64_t frame_heap_allocs;	// heap_alloc() calls made by steady-state frames
+
+	// the state the next snapshot saves, and the scene of a readback in flight
+	scene_state_s saved_scene;
+	float saved_state[NUM_EMITTERS * NUM_PARTICLES * PARTICLE_STATE_SIZE];
+	Eina_Bool saved_valid;
+	scene_state_s readback_scene;
+	snapshot_writer_s snapshot;
+
+	// offscreen targets the scene is drawn into, by view size
+	rtpool_s targets;
+
+	// byte sizes of the GL objects above, LRU eviction of cached ones
+	gpumem_s gpumem;
+
+	// CPU work of a frame runs on these threads, GL stays on this one
+	job_system_s jobs;
+
+	// GL command capture / replay, see capture.h
+	capture_s capture;
+	replay_s replay;
 
 	Eina_Bool initialized;
 } appdata_s;
@@ -0,0 +1,140 @@
+/*
+ * particles.h
+ *
+ * CPU side particle kernels. Nothing in here depends on EFL or GL, so the
+ * same code runs in the app and in host side tools.
+ */
+
+#ifndef PARTICLES_H_
+#define PARTICLES_H_
+
+#include <stdint.h>
+
+/*
+ * Per particle vertex layout, PARTICLE_SIZE floats:
+ *   [0]    lifetime in seconds
+ *   [1..3] a_startPosition, offset from the emitter center
+ *   [4..6] a_endPosition, distance travelled per second
+ */
+#define PARTICLE_SIZE 7
+
+/*
+ * Simulated state, PARTICLE_STATE_SIZE floats per particle:
+ *   [0..2] position, emitter center included
+ *   [3..5] velocity
+ */
+#define PARTICLE_STATE_SIZE 6
+
+#define PARTICLE_MAX_FORCES 8
+
+/*
+ * Force and collider types. Forces add to the acceleration, colliders are
+ * applied after integration and push particles back out.
+ *
+ *   GRAVITY     vector.xyz acceleration, scaled by strength
+ *   DRAG        strength: fraction of the velocity removed per second
+ *   ATTRACTOR   vector.xyz position, strength, params[2] softening radius
+ *   TURBULENCE  strength, params[2] spatial frequency, params[3] speed
+ *   PLANE       vector.xyz normal, vector.w offset along the normal,
+ *               params[2] restitution, params[3] friction
+ *   SPHERE      vector.xyz center, vector.w radius,
+ *               params[2] restitution, params[3] friction
+ */
+typedef enum {
+	PARTICLE_FORCE_GRAVITY,
+	PARTICLE_FORCE_DRAG,
+	PARTICLE_FORCE_ATTRACTOR,
+	PARTICLE_FORCE_TURBULENCE,
+	PARTICLE_COLLIDER_PLANE,
+	PARTICLE_COLLIDER_SPHERE,
+	PARTICLE_FORCE_TYPE_COUNT
+} particle_force_type_e;
+
+/*
+ * One force or collider. The layout matches the std140 Force struct of the
+ * GPU update shader, so a force list is uploaded with a plain copy.
+ *   params[0] type, params[1] strength, params[2..3] type specific
+ */
+typedef struct {
+	float params[4];
+	float vector[4];
+} particle_force_s;
+
+/*
+ * Cost counters of one force, accumulated by particles_simulate()
+ */
+typedef struct {
+	uint64_t evaluations;
+	uint64_t ns;
+} particle_force_stats_s;
+
+/*
+ * Private random generator for the simulation. Unlike rand(), nothing else
+ * in the process can advance it, so a given seed always produces the same
+ * particles and the same bursts.
+ */
+typedef struct {
+	uint32_t state;
+} particle_rng_s;
+
+/*
+ * @brief Seed the generator
+ */
+void particle_rng_seed(particle_rng_s *rng, uint32_t seed);
+
+/*
+ * @brief Next raw 32-bit value (xorshift32)
+ */
+uint32_t particle_rng_next(particle_rng_s *rng);
+
+/*
+ * @brief Next value in [0, 1)
+ */
+float particle_rng_float(particle_rng_s *rng);
+
+/*
+ * @brief Fill <count> particles of PARTICLE_SIZE floats
+ * @param[out] data particle vertex data
+ * @param[in] count number of particles
+ * @param[in] rng generator to draw from
+ */
+void particles_init(float *data, int count, particle_rng_s *rng);
+
+/*
+ * @brief Pick the center and color of a new burst
+ * @param[in] rng generator to draw from
+ * @param[out] center emitter center
+ * @param[out] color emitter color, alpha 0.5
+ */
+void particles_pick_burst(particle_rng_s *rng, float center[3], float color[4]);
+
+/*
+ * @brief Restart particles at the emitter center
+ * @param[in] data particle vertex data
+ * @param[out] state simulated state
+ * @param[in] count number of particles
+ * @param[in] center emitter center
+ */
+void particles_reset_state(const float *data, float *state, int count, const float center[3]);
+
+/*
+ * @brief Advance the simulated state by one step. This is the CPU reference
+ *        of the GPU update shader and must stay in sync with it.
+ * @param[in,out] state simulated state
+ * @param[in] count number of particles
+ * @param[in] forces forces and colliders
+ * @param[in] forceCount number of <forces>
+ * @param[in] dt time step
+ * @param[in] time total simulated time, animates the turbulence
+ * @param[out] accel scratch space of 3 floats per particle
+ * @param[in,out] stats per force cost counters, or NULL
+ */
+void particles_simulate(float *state, int count, const particle_force_s *forces, int forceCount,
+		float dt, float time, float *accel, particle_force_stats_s *stats);
+
+/*
+ * @brief Name of a force type, for logging
+ */
+const char *particle_force_name(int type);
+
+#endif /* PARTICLES_H_ */
@@ -0,0 +1,114 @@
+/*
+ * rtpool.h
+ *
+ * Pool of offscreen render targets.
+ *
+ * With ELM_GLVIEW_RESIZE_POLICY_SCALE the GL surface survives resizes and
+ * rotations; the scene is drawn into an offscreen target of the view size
+ * and blitted to the surface. Target sizes are rounded up to RTPOOL_BUCKET
+ * pixels, so small resizes keep drawing into the same target, and the last
+ * few targets stay allocated, so rotating back and forth does not allocate
+ * anything. rtpool_prewarm() creates the target of the other orientation
+ * ahead of the rotation.
+ *
+ * A target is a color texture and a depth texture behind one framebuffer.
+ * Pools made for a depth pre-pass give every target a second depth texture
+ * behind a framebuffer of its own: the pre-pass renders the opaque scene
+ * into it, and the particle pass samples it while it tests against the
+ * copy in the target's depth buffer, so no texture is read and attached at
+ * the same time.
+ * Targets are registered with the GPU memory registry as evictable, except
+ * the one last acquired, which the frame draws into: it stays pinned until
+ * another target replaces it, so the budget can neither evict it while it
+ * is created nor between frames. Its size is reserved on top of the
+ * memory budget (gpumem_reserve()), so at any view size the budget still
+ * leaves room for programs and buffers. An evicted target is simply
+ * recreated by the next rtpool_acquire(). Prewarming never evicts: the target of the
+ * other orientation is only created if it fits in the memory limit.
+ */
+
+#ifndef RTPOOL_H_
+#define RTPOOL_H_
+
+#include <Elementary.h>
+#include <stdint.h>
+
+#include "gpumem.h"
+
+#define RTPOOL_MAX_TARGETS 3
+#define RTPOOL_BUCKET 64
+
+typedef struct {
+	GLuint fbo;		/* 0 when the slot is free */
+	GLuint color;
+	GLuint depth;
+	GLuint depth_fbo;	/* scene depth pre-pass, 0 unless the pool has one */
+	GLuint scene_depth;
+	int bucket_w, bucket_h;	/* allocated size */
+	int width, height;	/* part used by the current view */
+	uint64_t last_use;
+} render_target_s;
+
+typedef struct {
+	render_target_s targets[RTPOOL_MAX_TARGETS];
+	gpumem_s *gpumem;
+	Eina_Bool scene_depth;	/* targets have a scene depth texture */
+	render_target_s *current;	/* last acquired, pinned */
+	uint64_t clock;
+
+	/* counters since the last report */
+	int hits;
+	int allocations;
+	double allocation_ms;
+} rtpool_s;
+
+/*
+ * @brief Start an empty pool
+ * @param[in] gpumem registry the targets are accounted in
+ * @param[in] sceneDepth give the targets a scene depth texture
+ */
+void rtpool_init(rtpool_s *pool, gpumem_s *gpumem, Eina_Bool sceneDepth);
+
+/*
+ * @brief Target for a <width> x <height> view, reused when one of the same
+ *        bucket exists. It becomes the pinned current target. The context
+ *        must be current.
+ * @return the target, NULL if no complete framebuffer could be made
+ */
+render_target_s *rtpool_acquire(rtpool_s *pool, int width, int height);
+
+/*
+ * @brief Acquire the target for <width> x <height> and create the one for
+ *        the rotated size too if it fits in the memory limit
+ */
+void rtpool_prewarm(rtpool_s *pool, int width, int height);
+
+/*
+ * @brief Bind <target> for drawing, viewport included
+ */
+void rtpool_bind(const render_target_s *target);
+
+/*
+ * @brief Bind the scene depth framebuffer of <target> for the depth
+ *        pre-pass, viewport included
+ */
+void rtpool_bind_scene_depth(const render_target_s *target);
+
+/*
+ * @brief Copy the scene depth of <target> into its depth buffer and bind
+ *        <target> for drawing
+ */
+void rtpool_resolve_scene_depth(const render_target_s *target);
+
+/*
+ * @brief Scale the drawn part of <target> onto the default framebuffer of
+ *        <width> x <height> and leave the default framebuffer bound
+ */
+void rtpool_present(const render_target_s *target, int width, int height);
+
+/*
+ * @brief Delete every target
+ */
+void rtpool_destroy(rtpool_s *pool);
+
+#endif /* RTPOOL_H_ */
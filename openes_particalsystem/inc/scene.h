@@ -0,0 +1,54 @@
+/*
+ * scene.h
+ *
+ * Opaque scene geometry: the colliders of the force list drawn as solids,
+ * for the depth-aware particle mode (PARTICLE_SOFT).
+ *
+ * Everything is in NDC like the particles, seen along z with depth
+ * growing from z = -1. Spheres are meshes. A plane collider is solid on
+ * the side its normal points away from, and what the view sees of that
+ * half-space is the part of the near face (z = -1) inside it; that is
+ * exact for planes along the view direction, which is all the scene has,
+ * and a tilted plane is drawn the same way. All colliders share one vertex
+ * buffer and one index buffer and are drawn with one call.
+ */
+
+#ifndef SCENE_H_
+#define SCENE_H_
+
+#include <Elementary.h>
+
+#include "gpumem.h"
+#include "particles.h"
+
+#define SCENE_SPHERE_SLICES 24
+#define SCENE_SPHERE_STACKS 12
+
+/* Attribute locations, clear of the particle and simulation ones */
+#define SCENE_POSITION_ATTRIB 5
+#define SCENE_NORMAL_ATTRIB 6
+
+typedef struct {
+	GLuint vbo;		// position and normal, 6 floats per vertex
+	GLuint ibo;		// GLushort triangles
+	GLsizei index_count;
+} scene_s;
+
+/*
+ * @brief Build the geometry of the colliders in <forces>; the other forces
+ *        are skipped
+ * @return EINA_TRUE on success, also when there is nothing to draw
+ */
+Eina_Bool scene_init(scene_s *scene, const particle_force_s *forces, int count, gpumem_s *gpumem);
+
+/*
+ * @brief Draw every collider with the bound program
+ */
+void scene_draw(const scene_s *scene);
+
+/*
+ * @brief Release GL objects
+ */
+void scene_destroy(scene_s *scene, gpumem_s *gpumem);
+
+#endif /* SCENE_H_ */
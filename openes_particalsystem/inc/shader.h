@@ -0,0 +1,38 @@
+/*
+ * shader.h
+ *
+ * Shader compilation helpers.
+ */
+
+#ifndef SHADER_H_
+#define SHADER_H_
+
+#include <Elementary.h>
+
+#include "arena.h"
+
+/*
+ * @brief create sharder program
+ * @param[in] scratch arena the info logs of failed builds are read into
+ * @return program object, 0 on compile or link failure
+ */
+GLuint CreateProgram(arena_s *scratch, const char *vertexShaderSrc, const char *fragmentShaderSrc);
+
+/*
+ * @brief create sharder program whose vertex outputs are captured with
+ *        transform feedback
+ * @param[in] scratch arena the info logs of failed builds are read into
+ * @param[in] varyings names of the captured outputs, interleaved in order
+ * @param[in] varyingCount number of <varyings>
+ * @return program object, 0 on compile or link failure
+ */
+GLuint CreateFeedbackProgram(arena_s *scratch, const char *vertexShaderSrc, const char *fragmentShaderSrc,
+		const char * const *varyings, int varyingCount);
+
+/*
+ * @brief Bind a uniform block of a program to a binding point, if the
+ *        program uses it
+ */
+void BindUniformBlock(GLuint program, const char *name, GLuint binding);
+
+#endif /* SHADER_H_ */
@@ -0,0 +1,121 @@
+/*
+ * simulation.h
+ *
+ * Particle simulation stage: forces (gravity, drag, point attractors,
+ * curl-noise turbulence) and colliders (planes, spheres).
+ *
+ * The state of every particle (position, velocity) lives in a GL buffer
+ * the render pass draws from. SIM_PATH_GPU advances it with a transform
+ * feedback pass that ping-pongs between two buffers, SIM_PATH_CPU runs the
+ * reference implementation in particles.c as jobs of SIM_JOB_PARTICLES
+ * particles across the job system, then submits the uploads the jobs
+ * recorded. Both read
+ * the whole force list from the ForceParams uniform block / the same array,
+ * so adding forces never adds draw calls. The GPU update program is a
+ * shader variant compiled with only the force types in the list, see
+ * variants.h.
+ *
+ * Build with -DPARTICLE_SIM_CPU to use the CPU path, or with
+ * -DPARTICLE_SIM_VALIDATE to run both and log how far the GPU state drifts
+ * from the reference. Per force cost counters are logged every
+ * SIM_STATS_FRAMES frames.
+ */
+
+#ifndef SIMULATION_H_
+#define SIMULATION_H_
+
+#include <Elementary.h>
+
+#include "particles.h"
+#include "uniforms.h"
+
+#define SIM_STATS_FRAMES 300
+#define SIM_VALIDATE_FRAMES 60
+#define SIM_JOB_PARTICLES 256	/* particles per CPU simulation job */
+
+/* Threads of the job system, see jobs_init(): the CPU path is its only user */
+#if defined(PARTICLE_SIM_CPU) || defined(PARTICLE_SIM_VALIDATE)
+#define SIM_JOB_THREADS 0
+#else
+#define SIM_JOB_THREADS 1
+#endif
+
+struct appdata;
+
+typedef enum {
+	SIM_PATH_GPU,
+	SIM_PATH_CPU,
+} sim_path_e;
+
+typedef struct {
+	sim_path_e path;
+	GLuint state_vbo[2];
+	int src;		// state buffer holding the current frame
+
+	// GPU path: copy of the state read back without stalling, for snapshots
+	GLuint readback_vbo;
+	GLsync readback_fence;
+
+	particle_force_s forces[PARTICLE_MAX_FORCES];
+	int force_count;
+	particle_force_stats_s stats[PARTICLE_MAX_FORCES];
+	int stats_frames;
+
+	// CPU copy of the state, used by the CPU path and for validation
+	float state[NUM_EMITTERS * NUM_PARTICLES * PARTICLE_STATE_SIZE];
+} simulation_s;
+
+/*
+ * @brief Create the update program and the state buffers; every emitter
+ *        starts from a reset burst, or from <restore>
+ * @param[in] restore state to start from, NULL to reset
+ * @return EINA_TRUE on success
+ */
+Eina_Bool simulation_init(simulation_s *sim, struct appdata *ad, const float *restore);
+
+/*
+ * @brief Append a force or collider
+ * @return index of the force, -1 if the list is full
+ */
+int simulation_add_force(simulation_s *sim, const particle_force_s *force);
+
+/*
+ * @brief Fill the ForceParams block
+ */
+void simulation_write_forces(const simulation_s *sim, force_params_s *params);
+
+/*
+ * @brief Advance every emitter by one step. The FrameParams and ForceParams
+ *        blocks must be bound.
+ * @param[in] emitterOffsets ring offsets of the EmitterParams blocks
+ * @param[in] dt time step
+ */
+void simulation_update(simulation_s *sim, struct appdata *ad, const GLintptr *emitterOffsets, float dt);
+
+/*
+ * @brief Buffer holding the current state, PARTICLE_STATE_SIZE floats per
+ *        particle, NUM_PARTICLES particles per emitter
+ */
+GLuint simulation_state_buffer(const simulation_s *sim);
+
+/*
+ * @brief GPU path: start copying the current state into the readback
+ *        buffer, behind a fence
+ * @return EINA_FALSE on the CPU path, whose state is always in <state>,
+ *         or while a readback is in flight
+ */
+Eina_Bool simulation_readback_begin(simulation_s *sim);
+
+/*
+ * @brief Copy a finished readback into <state>, without waiting for one in
+ *        flight
+ * @return EINA_TRUE if <state> was written
+ */
+Eina_Bool simulation_readback_poll(simulation_s *sim, float *state);
+
+/*
+ * @brief Release GL objects
+ */
+void simulation_destroy(simulation_s *sim, struct appdata *ad);
+
+#endif /* SIMULATION_H_ */
@@ -0,0 +1,130 @@
+/*
+ * snapshot.h
+ *
+ * Particle state snapshots.
+ *
+ * A snapshot file is a header followed by the particle vertex data, the
+ * simulated state and the emitters, each 16-byte aligned, in the layout
+ * the app keeps in memory. Restoring maps the file and uploads straight
+ * from the mapping: nothing is parsed, the header is only checked against
+ * the build's counts and version.
+ *
+ *   snapshot_header_s
+ *   float data[particle_count * particle_size]
+ *   float state[emitter_count * particle_count * state_size]
+ *   snapshot_emitter_s emitters[emitter_count]
+ *
+ * Writing happens on a thread: the caller fills the writer's buffer, which
+ * takes a few memcpy, and snapshot_write_async() returns right away. The
+ * file is written aside, synced and renamed, so a kill during the write
+ * leaves the previous snapshot in place. Nothing in here depends on EFL or
+ * GL.
+ */
+
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC 0x504e5350u	/* "PSNP" */
+#define SNAPSHOT_VERSION 1
+
+typedef struct {
+	float center[3];
+	float color[4];
+	float time;
+	uint32_t burst;
+	uint32_t pad[3];
+} snapshot_emitter_s;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t particle_count;	/* particle vertex data entries, shared by the emitters */
+	uint32_t emitter_count;
+	uint32_t particle_size;	/* floats per particle vertex */
+	uint32_t state_size;	/* floats per simulated particle */
+	uint32_t frame;
+	uint32_t rng;
+	float time;		/* total simulated time */
+	uint64_t data_offset;
+	uint64_t state_offset;
+	uint64_t emitters_offset;
+	uint64_t file_size;
+} snapshot_header_s;
+
+/*
+ * A mapped snapshot; the pointers are into the mapping
+ */
+typedef struct {
+	void *map;
+	size_t size;
+	const snapshot_header_s *header;
+	const float *data;
+	const float *state;
+	const snapshot_emitter_s *emitters;
+} snapshot_s;
+
+typedef struct {
+	pthread_t thread;
+	int busy;		/* a write is running, join before touching <buffer> */
+	int result;		/* of the last finished write, 0 on success */
+	void *buffer;
+	size_t size;
+	size_t capacity;
+	char path[PATH_MAX];
+} snapshot_writer_s;
+
+/*
+ * @brief Fill the counts, offsets and size of <header>
+ * @return file size
+ */
+size_t snapshot_layout(snapshot_header_s *header, int particleCount, int emitterCount, int particleSize, int stateSize);
+
+/*
+ * @brief Allocate the writer's buffer
+ * @return 0, -1 if out of memory
+ */
+int snapshot_writer_init(snapshot_writer_s *writer, size_t capacity);
+
+/*
+ * @brief Wait for a running write, then hand out the buffer to fill
+ * @return buffer of the writer's capacity, the header first
+ */
+void *snapshot_writer_begin(snapshot_writer_s *writer);
+
+/*
+ * @brief Write the first <size> bytes of the buffer to <path> on a thread.
+ *        Falls back to writing on the calling thread if none can be started.
+ * @return 0 if the write started (or finished)
+ */
+int snapshot_write_async(snapshot_writer_s *writer, const char *path, size_t size);
+
+/*
+ * @brief Wait for a running write
+ * @return its result, 0 on success
+ */
+int snapshot_writer_join(snapshot_writer_s *writer);
+
+/*
+ * @brief Join and free the buffer
+ */
+void snapshot_writer_destroy(snapshot_writer_s *writer);
+
+/*
+ * @brief Map a snapshot and check its header: magic, version, sizes and
+ *        offsets within the file
+ * @return 0, -1 if missing or not valid
+ */
+int snapshot_map(snapshot_s *snapshot, const char *path);
+
+/*
+ * @brief Release the mapping
+ */
+void snapshot_unmap(snapshot_s *snapshot);
+
+#endif /* SNAPSHOT_H_ */
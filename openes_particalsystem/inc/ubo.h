@@ -0,0 +1,79 @@
+/*
+ * ubo.h
+ *
+ * Ring buffered uniform buffer object.
+ *
+ * One GL buffer is split into UBO_RING_SLICES slices and every frame
+ * writes its uniform blocks into the next slice with a single mapping, so
+ * per-frame and per-emitter parameters cost one upload plus one
+ * glBindBufferRange per block, whatever the number of emitters. A fence per
+ * slice makes sure the GPU is done reading a slice before it is rewritten.
+ */
+
+#ifndef UBO_H_
+#define UBO_H_
+
+#include <Elementary.h>
+
+#define UBO_RING_SLICES 3
+
+typedef struct {
+	GLuint buffer;
+	GLsizeiptr slice_size;
+	GLint alignment;
+	int slice;
+	GLintptr offset;	/* next free byte in the current slice */
+	unsigned char *mapped;	/* current slice while between begin and end */
+	GLsync fences[UBO_RING_SLICES];
+} ubo_ring_s;
+
+/*
+ * @brief Create the ring buffer
+ * @param[in] ring ring state
+ * @param[in] blocks number of blocks written per frame
+ * @param[in] block_size size of the largest block
+ * @return EINA_TRUE on success
+ */
+Eina_Bool ubo_ring_init(ubo_ring_s *ring, int blocks, GLsizeiptr block_size);
+
+/*
+ * @brief Size of a block once padded to the uniform buffer offset alignment
+ */
+GLsizeiptr ubo_ring_block_size(const ubo_ring_s *ring, GLsizeiptr size);
+
+/*
+ * @brief Map the next slice for this frame's blocks
+ * @return EINA_TRUE if the slice is mapped
+ */
+Eina_Bool ubo_ring_begin(ubo_ring_s *ring);
+
+/*
+ * @brief Reserve an aligned block in the current slice
+ * @param[in] ring ring state
+ * @param[in] size block size
+ * @param[out] offset buffer offset of the block, for ubo_ring_bind()
+ * @return CPU pointer to write the block to, NULL if the slice is full
+ */
+void *ubo_ring_alloc(ubo_ring_s *ring, GLsizeiptr size, GLintptr *offset);
+
+/*
+ * @brief Unmap the current slice; must be called before drawing
+ */
+void ubo_ring_end(ubo_ring_s *ring);
+
+/*
+ * @brief Bind a block to a uniform buffer binding point
+ */
+void ubo_ring_bind(ubo_ring_s *ring, GLuint binding, GLintptr offset, GLsizeiptr size);
+
+/*
+ * @brief Fence the current slice once the frame's draws are submitted
+ */
+void ubo_ring_fence(ubo_ring_s *ring);
+
+/*
+ * @brief Release the buffer and fences
+ */
+void ubo_ring_destroy(ubo_ring_s *ring);
+
+#endif /* UBO_H_ */
@@ -0,0 +1,73 @@
+/*
+ * uniforms.h
+ *
+ * std140 uniform blocks shared by the render and simulation programs, as
+ * GLSL source snippets and as the matching C structs written into the ring
+ * buffer. Members are highp in every stage because a block used by both the
+ * vertex and fragment shader must match exactly.
+ */
+
+#ifndef UNIFORMS_H_
+#define UNIFORMS_H_
+
+#include <Elementary.h>
+
+#include "particles.h"
+
+#define FRAME_PARAMS_BINDING 0
+#define EMITTER_PARAMS_BINDING 1
+#define FORCE_PARAMS_BINDING 2
+
+#define FRAME_PARAMS_BLOCK \
+		"layout(std140) uniform FrameParams {\n" \
+		"  highp vec4 u_viewport;\n" /* width, height, 1/width, 1/height */ \
+		"  highp float u_frameTime;\n" \
+		"  highp float u_timeStep;\n" \
+		"  highp vec4 u_depth;\n" /* 1/target width, 1/target height, soft fade scale, 0 */ \
+		"};\n"
+
+#define EMITTER_PARAMS_BLOCK \
+		"layout(std140) uniform EmitterParams {\n" \
+		"  highp vec4 u_centerPosition;\n" \
+		"  highp vec4 u_color;\n" \
+		"  highp float u_time;\n" \
+		"  highp float u_burst;\n" /* 1.0 on the frame a burst restarts */ \
+		"  highp vec4 u_lod;\n" /* count, fade band, point scale, alpha scale, see lod.h */ \
+		"};\n"
+
+#define STR(x) #x
+#define XSTR(x) STR(x)
+
+#define FORCE_PARAMS_BLOCK \
+		"struct Force {\n" \
+		"  highp vec4 params;\n" \
+		"  highp vec4 vector;\n" \
+		"};\n" \
+		"layout(std140) uniform ForceParams {\n" \
+		"  highp ivec4 u_forceCount;\n" \
+		"  Force u_forces[" XSTR(PARTICLE_MAX_FORCES) "];\n" \
+		"};\n"
+
+typedef struct {
+	GLfloat viewport[4];
+	GLfloat frameTime;
+	GLfloat timeStep;
+	GLfloat pad[2];
+	GLfloat depth[4];
+} frame_params_s;
+
+typedef struct {
+	GLfloat centerPosition[4];
+	GLfloat color[4];
+	GLfloat time;
+	GLfloat burst;
+	GLfloat pad[2];
+	GLfloat lod[4];
+} emitter_params_s;
+
+typedef struct {
+	GLint count[4];
+	particle_force_s forces[PARTICLE_MAX_FORCES];
+} force_params_s;
+
+#endif /* UNIFORMS_H_ */
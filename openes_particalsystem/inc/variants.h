@@ -0,0 +1,105 @@
+/*
+ * variants.h
+ *
+ * Shader variants built from feature bits.
+ *
+ * A shader family is one vertex/fragment source pair written with #ifdef
+ * blocks around its optional features. A variant is the family compiled
+ * with a set of features: bit i of the feature mask defines the family's
+ * i-th feature name, injected right after the #version line. Each variant
+ * only carries the code its configuration uses, so the shaders never branch
+ * on a feature at run time.
+ *
+ * Variants are compiled on first use and cached. variants_prewarm() compiles
+ * a declared set while loading, so the first frames do not stall on the
+ * compiler. Compiled programs are registered with the GPU memory registry
+ * as evictable: an evicted variant is compiled again by the next
+ * variants_get(), so callers fetch their program every frame instead of
+ * keeping the name. The registry only evicts in gpumem_apply() at the start
+ * of a frame, and spares what was fetched or compiled since the previous
+ * one, so a program returned in a frame stays valid through it and the
+ * next one's apply.
+ */
+
+#ifndef VARIANTS_H_
+#define VARIANTS_H_
+
+#include <Elementary.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "gpumem.h"
+
+#define VARIANTS_MAX 32
+#define VARIANT_MAX_FEATURES 16
+
+typedef uint32_t variant_features_t;
+
+typedef struct {
+	const char *name;
+	GLuint binding;
+} variant_block_s;
+
+typedef struct {
+	const char *label;		/* static string, for logs and gpumem reports */
+	const char *vertex;		/* sources, starting with their #version line */
+	const char *fragment;
+	const char * const *features;	/* macro defined by each feature bit */
+	int feature_count;
+	const char * const *varyings;	/* transform feedback outputs, or NULL */
+	int varying_count;
+	const variant_block_s *blocks;	/* uniform blocks bound after linking */
+	int block_count;
+} variant_family_s;
+
+typedef struct {
+	const variant_family_s *family;	/* NULL when the slot is free */
+	variant_features_t features;
+	GLuint program;		/* 0 if the variant failed to build */
+	uint64_t last_use;
+} variant_s;
+
+typedef struct {
+	variant_s variants[VARIANTS_MAX];
+	arena_s *scratch;
+	gpumem_s *gpumem;
+	uint64_t clock;
+
+	/* counters since the last report */
+	int compiled;
+	int failed;
+	int hits;
+	double compile_ms;
+} variants_s;
+
+/*
+ * @brief Start an empty cache
+ * @param[in] scratch arena the sources and info logs are built in
+ * @param[in] gpumem registry the programs are accounted in
+ */
+void variants_init(variants_s *variants, arena_s *scratch, gpumem_s *gpumem);
+
+/*
+ * @brief Program of <family> with <features>, compiled if not cached.
+ *        The context must be current.
+ * @return program object, 0 if the variant does not build
+ */
+GLuint variants_get(variants_s *variants, const variant_family_s *family, variant_features_t features);
+
+/*
+ * @brief Compile the <count> variants of <family> in <set> ahead of use
+ * @return number of variants that built
+ */
+int variants_prewarm(variants_s *variants, const variant_family_s *family, const variant_features_t *set, int count);
+
+/*
+ * @brief Log the cached variants and the compile counters, then reset them
+ */
+void variants_report(variants_s *variants);
+
+/*
+ * @brief Delete every cached program
+ */
+void variants_destroy(variants_s *variants);
+
+#endif /* VARIANTS_H_ */
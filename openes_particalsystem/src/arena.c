@@ -0,0 +1,59 @@
+/*
+ * arena.c
+ *
+ * Linear allocators for transient memory, see arena.h.
+ */
+
+#include "arena.h"
+
+#include <stdlib.h>
+
+static uint64_t g_heap_allocs;
+
+int arena_init(arena_s *arena, size_t capacity)
+{
+	arena->base = heap_alloc(capacity);
+	arena->capacity = arena->base ? capacity : 0;
+	arena->used = 0;
+	arena->peak = 0;
+	arena->failures = 0;
+	return arena->base ? 0 : -1;
+}
+
+void *arena_alloc(arena_s *arena, size_t size)
+{
+	size_t offset = (arena->used + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+	if (offset > arena->capacity || size > arena->capacity - offset) {
+		arena->failures++;
+		return NULL;
+	}
+	arena->used = offset + size;
+	if (arena->used > arena->peak) {
+		arena->peak = arena->used;
+	}
+	return arena->base + offset;
+}
+
+void arena_destroy(arena_s *arena)
+{
+	heap_free(arena->base);
+	arena->base = NULL;
+	arena->capacity = 0;
+	arena->used = 0;
+}
+
+void *heap_alloc(size_t size)
+{
+	g_heap_allocs++;
+	return malloc(size);
+}
+
+void heap_free(void *pointer)
+{
+	free(pointer);
+}
+
+uint64_t heap_alloc_count(void)
+{
+	return g_heap_allocs;
+}
@@ -0,0 +1,772 @@
+/*
+ * capture.c
+ *
+ * Recording side of the GL command capture, see capture.h.
+ */
+
+#include "capture.h"
+
+#include <string.h>
+#include <dlog.h>
+
+#include "openes_particalsystem.h"
+
+/*
+ * Elementary_GL_Helpers.h is deliberately not included here: it turns every
+ * gl* identifier into a macro, which would also rewrite the member names of
+ * the Evas_GL_API table this file patches.
+ */
+extern Evas_GL_API *__evas_gl_glapi;
+
+/* The GL wrappers have no user data, so only one capture can run at a time */
+static capture_s *g_cap;
+static Evas_GL_API g_record_api;
+
+static const char *op_names[CAPTURE_OP_COUNT] = {
+	[CAPTURE_OP_CREATE_SHADER] = "glCreateShader",
+	[CAPTURE_OP_SHADER_SOURCE] = "glShaderSource",
+	[CAPTURE_OP_COMPILE_SHADER] = "glCompileShader",
+	[CAPTURE_OP_DELETE_SHADER] = "glDeleteShader",
+	[CAPTURE_OP_CREATE_PROGRAM] = "glCreateProgram",
+	[CAPTURE_OP_ATTACH_SHADER] = "glAttachShader",
+	[CAPTURE_OP_LINK_PROGRAM] = "glLinkProgram",
+	[CAPTURE_OP_DELETE_PROGRAM] = "glDeleteProgram",
+	[CAPTURE_OP_GET_UNIFORM_LOCATION] = "glGetUniformLocation",
+	[CAPTURE_OP_USE_PROGRAM] = "glUseProgram",
+	[CAPTURE_OP_UNIFORM1F] = "glUniform1f",
+	[CAPTURE_OP_UNIFORM1I] = "glUniform1i",
+	[CAPTURE_OP_UNIFORM3FV] = "glUniform3fv",
+	[CAPTURE_OP_UNIFORM4FV] = "glUniform4fv",
+	[CAPTURE_OP_CLEAR_COLOR] = "glClearColor",
+	[CAPTURE_OP_CLEAR] = "glClear",
+	[CAPTURE_OP_VIEWPORT] = "glViewport",
+	[CAPTURE_OP_ENABLE] = "glEnable",
+	[CAPTURE_OP_DISABLE] = "glDisable",
+	[CAPTURE_OP_BLEND_FUNC] = "glBlendFunc",
+	[CAPTURE_OP_ENABLE_VERTEX_ATTRIB_ARRAY] = "glEnableVertexAttribArray",
+	[CAPTURE_OP_DISABLE_VERTEX_ATTRIB_ARRAY] = "glDisableVertexAttribArray",
+	[CAPTURE_OP_VERTEX_ATTRIB_POINTER] = "glVertexAttribPointer",
+	[CAPTURE_OP_CLIENT_ATTRIB] = "glVertexAttribPointer(client)",
+	[CAPTURE_OP_GEN_BUFFERS] = "glGenBuffers",
+	[CAPTURE_OP_DELETE_BUFFERS] = "glDeleteBuffers",
+	[CAPTURE_OP_BIND_BUFFER] = "glBindBuffer",
+	[CAPTURE_OP_BUFFER_DATA] = "glBufferData",
+	[CAPTURE_OP_BUFFER_SUB_DATA] = "glBufferSubData",
+	[CAPTURE_OP_DRAW_ARRAYS] = "glDrawArrays",
+	[CAPTURE_OP_DRAW_ELEMENTS] = "glDrawElements",
+	[CAPTURE_OP_FLUSH] = "glFlush",
+	[CAPTURE_OP_FRAME_BEGIN] = "frame begin",
+	[CAPTURE_OP_FRAME_END] = "frame end",
+	[CAPTURE_OP_END] = "end",
+	[CAPTURE_OP_GET_UNIFORM_BLOCK_INDEX] = "glGetUniformBlockIndex",
+	[CAPTURE_OP_UNIFORM_BLOCK_BINDING] = "glUniformBlockBinding",
+	[CAPTURE_OP_BIND_BUFFER_RANGE] = "glBindBufferRange",
+	[CAPTURE_OP_TRANSFORM_FEEDBACK_VARYINGS] = "glTransformFeedbackVaryings",
+	[CAPTURE_OP_BEGIN_TRANSFORM_FEEDBACK] = "glBeginTransformFeedback",
+	[CAPTURE_OP_END_TRANSFORM_FEEDBACK] = "glEndTransformFeedback",
+	[CAPTURE_OP_BIND_BUFFER_BASE] = "glBindBufferBase",
+	[CAPTURE_OP_GEN_TEXTURES] = "glGenTextures",
+	[CAPTURE_OP_DELETE_TEXTURES] = "glDeleteTextures",
+	[CAPTURE_OP_BIND_TEXTURE] = "glBindTexture",
+	[CAPTURE_OP_TEX_STORAGE_2D] = "glTexStorage2D",
+	[CAPTURE_OP_TEX_PARAMETERI] = "glTexParameteri",
+	[CAPTURE_OP_GEN_FRAMEBUFFERS] = "glGenFramebuffers",
+	[CAPTURE_OP_DELETE_FRAMEBUFFERS] = "glDeleteFramebuffers",
+	[CAPTURE_OP_BIND_FRAMEBUFFER] = "glBindFramebuffer",
+	[CAPTURE_OP_FRAMEBUFFER_TEXTURE_2D] = "glFramebufferTexture2D",
+	[CAPTURE_OP_BLIT_FRAMEBUFFER] = "glBlitFramebuffer",
+	[CAPTURE_OP_COPY_BUFFER_SUB_DATA] = "glCopyBufferSubData",
+	[CAPTURE_OP_ACTIVE_TEXTURE] = "glActiveTexture",
+	[CAPTURE_OP_DEPTH_FUNC] = "glDepthFunc",
+	[CAPTURE_OP_DEPTH_MASK] = "glDepthMask",
+};
+
+const char *capture_op_name(capture_op_e op)
+{
+	if (op <= 0 || op >= CAPTURE_OP_COUNT || !op_names[op]) {
+		return "unknown";
+	}
+	return op_names[op];
+}
+
+static uint32_t f2u(GLfloat f)
+{
+	uint32_t u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+/*
+ * @brief Append one record; trailing data is padded to 4 bytes
+ */
+static void write_record(capture_op_e op, const uint32_t *words, int nwords, const void *data, size_t size)
+{
+	static const unsigned char pad[4] = { 0, };
+	capture_record_header_s header;
+
+	header.op = op;
+	header.words = nwords;
+	header.size = size;
+	fwrite(&header, sizeof(header), 1, g_cap->file);
+	if (nwords > 0) {
+		fwrite(words, sizeof(uint32_t), nwords, g_cap->file);
+	}
+	if (size > 0) {
+		fwrite(data, 1, size, g_cap->file);
+		if (size & 3) {
+			fwrite(pad, 1, 4 - (size & 3), g_cap->file);
+		}
+	}
+	g_cap->counts[op]++;
+}
+
+static size_t type_size(GLenum type)
+{
+	switch (type) {
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		return 1;
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+	case GL_HALF_FLOAT:
+		return 2;
+	default:
+		return 4;
+	}
+}
+
+/*
+ * @brief Emit the client-side vertex data a draw call is about to read
+ * @param[in] first first vertex
+ * @param[in] count number of vertices from <first>
+ */
+static void write_client_attribs(GLint first, GLsizei count)
+{
+	for (int i = 0; i < CAPTURE_MAX_ATTRIBS; ++i) {
+		capture_attrib_s *attrib = &g_cap->attribs[i];
+		if (!attrib->enabled || !attrib->client || count <= 0) {
+			continue;
+		}
+		size_t element = (attrib->type == GL_INT_2_10_10_10_REV || attrib->type == GL_UNSIGNED_INT_2_10_10_10_REV) ?
+				4 : attrib->size * type_size(attrib->type);
+		size_t stride = attrib->stride ? (size_t)attrib->stride : element;
+		uint32_t words[6] = { i, attrib->size, attrib->type, attrib->normalized, stride, first };
+		write_record(CAPTURE_OP_CLIENT_ATTRIB, words, 6,
+				(const unsigned char *)attrib->pointer + first * stride, (count - 1) * stride + element);
+	}
+}
+
+static GLuint rec_glCreateShader(GLenum type)
+{
+	GLuint shader = g_cap->real->glCreateShader(type);
+	uint32_t words[2] = { type, shader };
+	write_record(CAPTURE_OP_CREATE_SHADER, words, 2, NULL, 0);
+	return shader;
+}
+
+static void rec_glShaderSource(GLuint shader, GLsizei count, const GLchar * const *string, const GLint *length)
+{
+	g_cap->real->glShaderSource(shader, count, string, length);
+
+	/* The parts are joined into one NUL terminated string */
+	uint32_t words[1] = { shader };
+	long pos = ftell(g_cap->file);
+	size_t size = 0;
+	write_record(CAPTURE_OP_SHADER_SOURCE, words, 1, NULL, 0);
+	for (int i = 0; i < count; ++i) {
+		size_t len = (length && length[i] >= 0) ? (size_t)length[i] : strlen(string[i]);
+		fwrite(string[i], 1, len, g_cap->file);
+		size += len;
+	}
+	fputc('\0', g_cap->file);
+	size++;
+	while (size & 3) {
+		fputc('\0', g_cap->file);
+		size++;
+	}
+	/* Patch the record size now that the source length is known */
+	long end = ftell(g_cap->file);
+	capture_record_header_s header = { CAPTURE_OP_SHADER_SOURCE, 1, size };
+	fseek(g_cap->file, pos, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, g_cap->file);
+	fseek(g_cap->file, end, SEEK_SET);
+}
+
+static void rec_glCompileShader(GLuint shader)
+{
+	g_cap->real->glCompileShader(shader);
+	uint32_t words[1] = { shader };
+	write_record(CAPTURE_OP_COMPILE_SHADER, words, 1, NULL, 0);
+}
+
+static void rec_glDeleteShader(GLuint shader)
+{
+	g_cap->real->glDeleteShader(shader);
+	uint32_t words[1] = { shader };
+	write_record(CAPTURE_OP_DELETE_SHADER, words, 1, NULL, 0);
+}
+
+static GLuint rec_glCreateProgram(void)
+{
+	GLuint program = g_cap->real->glCreateProgram();
+	uint32_t words[1] = { program };
+	write_record(CAPTURE_OP_CREATE_PROGRAM, words, 1, NULL, 0);
+	return program;
+}
+
+static void rec_glAttachShader(GLuint program, GLuint shader)
+{
+	g_cap->real->glAttachShader(program, shader);
+	uint32_t words[2] = { program, shader };
+	write_record(CAPTURE_OP_ATTACH_SHADER, words, 2, NULL, 0);
+}
+
+static void rec_glLinkProgram(GLuint program)
+{
+	g_cap->real->glLinkProgram(program);
+	uint32_t words[1] = { program };
+	write_record(CAPTURE_OP_LINK_PROGRAM, words, 1, NULL, 0);
+}
+
+static void rec_glDeleteProgram(GLuint program)
+{
+	g_cap->real->glDeleteProgram(program);
+	uint32_t words[1] = { program };
+	write_record(CAPTURE_OP_DELETE_PROGRAM, words, 1, NULL, 0);
+}
+
+static GLint rec_glGetUniformLocation(GLuint program, const GLchar *name)
+{
+	GLint location = g_cap->real->glGetUniformLocation(program, name);
+	uint32_t words[2] = { program, location };
+	write_record(CAPTURE_OP_GET_UNIFORM_LOCATION, words, 2, name, strlen(name) + 1);
+	return location;
+}
+
+static void rec_glUseProgram(GLuint program)
+{
+	g_cap->real->glUseProgram(program);
+	uint32_t words[1] = { program };
+	write_record(CAPTURE_OP_USE_PROGRAM, words, 1, NULL, 0);
+}
+
+static void rec_glUniform1f(GLint location, GLfloat x)
+{
+	g_cap->real->glUniform1f(location, x);
+	uint32_t words[2] = { location, f2u(x) };
+	write_record(CAPTURE_OP_UNIFORM1F, words, 2, NULL, 0);
+}
+
+static void rec_glUniform1i(GLint location, GLint x)
+{
+	g_cap->real->glUniform1i(location, x);
+	uint32_t words[2] = { location, x };
+	write_record(CAPTURE_OP_UNIFORM1I, words, 2, NULL, 0);
+}
+
+static void rec_glUniform3fv(GLint location, GLsizei count, const GLfloat *v)
+{
+	g_cap->real->glUniform3fv(location, count, v);
+	uint32_t words[2] = { location, count };
+	write_record(CAPTURE_OP_UNIFORM3FV, words, 2, v, count * 3 * sizeof(GLfloat));
+}
+
+static void rec_glUniform4fv(GLint location, GLsizei count, const GLfloat *v)
+{
+	g_cap->real->glUniform4fv(location, count, v);
+	uint32_t words[2] = { location, count };
+	write_record(CAPTURE_OP_UNIFORM4FV, words, 2, v, count * 4 * sizeof(GLfloat));
+}
+
+static void rec_glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha)
+{
+	g_cap->real->glClearColor(red, green, blue, alpha);
+	uint32_t words[4] = { f2u(red), f2u(green), f2u(blue), f2u(alpha) };
+	write_record(CAPTURE_OP_CLEAR_COLOR, words, 4, NULL, 0);
+}
+
+static void rec_glClear(GLbitfield mask)
+{
+	g_cap->real->glClear(mask);
+	uint32_t words[1] = { mask };
+	write_record(CAPTURE_OP_CLEAR, words, 1, NULL, 0);
+}
+
+static void rec_glViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	g_cap->real->glViewport(x, y, width, height);
+	uint32_t words[4] = { x, y, width, height };
+	write_record(CAPTURE_OP_VIEWPORT, words, 4, NULL, 0);
+}
+
+static void rec_glEnable(GLenum cap)
+{
+	g_cap->real->glEnable(cap);
+	uint32_t words[1] = { cap };
+	write_record(CAPTURE_OP_ENABLE, words, 1, NULL, 0);
+}
+
+static void rec_glDisable(GLenum cap)
+{
+	g_cap->real->glDisable(cap);
+	uint32_t words[1] = { cap };
+	write_record(CAPTURE_OP_DISABLE, words, 1, NULL, 0);
+}
+
+static void rec_glBlendFunc(GLenum sfactor, GLenum dfactor)
+{
+	g_cap->real->glBlendFunc(sfactor, dfactor);
+	uint32_t words[2] = { sfactor, dfactor };
+	write_record(CAPTURE_OP_BLEND_FUNC, words, 2, NULL, 0);
+}
+
+static void rec_glDepthFunc(GLenum func)
+{
+	g_cap->real->glDepthFunc(func);
+	uint32_t words[1] = { func };
+	write_record(CAPTURE_OP_DEPTH_FUNC, words, 1, NULL, 0);
+}
+
+static void rec_glDepthMask(GLboolean flag)
+{
+	g_cap->real->glDepthMask(flag);
+	uint32_t words[1] = { flag };
+	write_record(CAPTURE_OP_DEPTH_MASK, words, 1, NULL, 0);
+}
+
+static void rec_glEnableVertexAttribArray(GLuint index)
+{
+	g_cap->real->glEnableVertexAttribArray(index);
+	if (index < CAPTURE_MAX_ATTRIBS) {
+		g_cap->attribs[index].enabled = EINA_TRUE;
+	}
+	uint32_t words[1] = { index };
+	write_record(CAPTURE_OP_ENABLE_VERTEX_ATTRIB_ARRAY, words, 1, NULL, 0);
+}
+
+static void rec_glDisableVertexAttribArray(GLuint index)
+{
+	g_cap->real->glDisableVertexAttribArray(index);
+	if (index < CAPTURE_MAX_ATTRIBS) {
+		g_cap->attribs[index].enabled = EINA_FALSE;
+	}
+	uint32_t words[1] = { index };
+	write_record(CAPTURE_OP_DISABLE_VERTEX_ATTRIB_ARRAY, words, 1, NULL, 0);
+}
+
+static void rec_glVertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void *pointer)
+{
+	g_cap->real->glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+	if (index >= CAPTURE_MAX_ATTRIBS) {
+		return;
+	}
+	capture_attrib_s *attrib = &g_cap->attribs[index];
+	attrib->client = (g_cap->array_buffer == 0);
+	attrib->pointer = pointer;
+	attrib->size = size;
+	attrib->type = type;
+	attrib->normalized = normalized;
+	attrib->stride = stride;
+	/* Client arrays are written by the draw call that reads them */
+	if (!attrib->client) {
+		uint32_t words[6] = { index, size, type, normalized, stride, (uint32_t)(uintptr_t)pointer };
+		write_record(CAPTURE_OP_VERTEX_ATTRIB_POINTER, words, 6, NULL, 0);
+	}
+}
+
+static void rec_glGenBuffers(GLsizei n, GLuint *buffers)
+{
+	g_cap->real->glGenBuffers(n, buffers);
+	uint32_t words[1] = { n };
+	write_record(CAPTURE_OP_GEN_BUFFERS, words, 1, buffers, n * sizeof(GLuint));
+}
+
+static void rec_glDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+	g_cap->real->glDeleteBuffers(n, buffers);
+	uint32_t words[1] = { n };
+	write_record(CAPTURE_OP_DELETE_BUFFERS, words, 1, buffers, n * sizeof(GLuint));
+}
+
+static void rec_glBindBuffer(GLenum target, GLuint buffer)
+{
+	g_cap->real->glBindBuffer(target, buffer);
+	if (target == GL_ARRAY_BUFFER) {
+		g_cap->array_buffer = buffer;
+	}
+	uint32_t words[2] = { target, buffer };
+	write_record(CAPTURE_OP_BIND_BUFFER, words, 2, NULL, 0);
+}
+
+static void rec_glBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+{
+	g_cap->real->glBufferData(target, size, data, usage);
+	uint32_t words[4] = { target, size, usage, data != NULL };
+	write_record(CAPTURE_OP_BUFFER_DATA, words, 4, data, data ? (size_t)size : 0);
+}
+
+static void rec_glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+{
+	g_cap->real->glBufferSubData(target, offset, size, data);
+	uint32_t words[3] = { target, offset, size };
+	write_record(CAPTURE_OP_BUFFER_SUB_DATA, words, 3, data, size);
+}
+
+static void *rec_glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+	void *pointer = g_cap->real->glMapBufferRange(target, offset, length, access);
+	if (pointer && (access & GL_MAP_WRITE_BIT)) {
+		if (g_cap->mapping.pointer) {
+			dlog_print(DLOG_WARN, LOG_TAG, "capture: only one mapped buffer is recorded at a time");
+		}
+		g_cap->mapping.target = target;
+		g_cap->mapping.offset = offset;
+		g_cap->mapping.length = length;
+		g_cap->mapping.pointer = pointer;
+	}
+	return pointer;
+}
+
+static GLboolean rec_glUnmapBuffer(GLenum target)
+{
+	/* Record what was written through the mapping before it goes away */
+	capture_mapping_s *mapping = &g_cap->mapping;
+	if (mapping->pointer && mapping->target == target) {
+		uint32_t words[3] = { target, mapping->offset, mapping->length };
+		write_record(CAPTURE_OP_BUFFER_SUB_DATA, words, 3, mapping->pointer, mapping->length);
+		mapping->pointer = NULL;
+	}
+	return g_cap->real->glUnmapBuffer(target);
+}
+
+static void rec_glCopyBufferSubData(GLenum readTarget, GLenum writeTarget, GLintptr readOffset, GLintptr writeOffset,
+		GLsizeiptr size)
+{
+	g_cap->real->glCopyBufferSubData(readTarget, writeTarget, readOffset, writeOffset, size);
+	uint32_t words[5] = { readTarget, writeTarget, readOffset, writeOffset, size };
+	write_record(CAPTURE_OP_COPY_BUFFER_SUB_DATA, words, 5, NULL, 0);
+}
+
+static GLuint rec_glGetUniformBlockIndex(GLuint program, const GLchar *name)
+{
+	GLuint index = g_cap->real->glGetUniformBlockIndex(program, name);
+	uint32_t words[2] = { program, index };
+	write_record(CAPTURE_OP_GET_UNIFORM_BLOCK_INDEX, words, 2, name, strlen(name) + 1);
+	return index;
+}
+
+static void rec_glUniformBlockBinding(GLuint program, GLuint index, GLuint binding)
+{
+	g_cap->real->glUniformBlockBinding(program, index, binding);
+	uint32_t words[3] = { program, index, binding };
+	write_record(CAPTURE_OP_UNIFORM_BLOCK_BINDING, words, 3, NULL, 0);
+}
+
+static void rec_glBindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	g_cap->real->glBindBufferRange(target, index, buffer, offset, size);
+	uint32_t words[5] = { target, index, buffer, offset, size };
+	write_record(CAPTURE_OP_BIND_BUFFER_RANGE, words, 5, NULL, 0);
+}
+
+static void rec_glBindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	g_cap->real->glBindBufferBase(target, index, buffer);
+	uint32_t words[3] = { target, index, buffer };
+	write_record(CAPTURE_OP_BIND_BUFFER_BASE, words, 3, NULL, 0);
+}
+
+static void rec_glTransformFeedbackVaryings(GLuint program, GLsizei count, const GLchar *const *varyings, GLenum bufferMode)
+{
+	/* The names are stored back to back, each with its terminator */
+	size_t size = 0;
+	for (GLsizei i = 0; i < count; ++i) {
+		size += strlen(varyings[i]) + 1;
+	}
+	char *names = heap_alloc(size ? size : 1);
+	if (names) {
+		char *p = names;
+		for (GLsizei i = 0; i < count; ++i) {
+			size_t length = strlen(varyings[i]) + 1;
+			memcpy(p, varyings[i], length);
+			p += length;
+		}
+		uint32_t words[3] = { program, count, bufferMode };
+		write_record(CAPTURE_OP_TRANSFORM_FEEDBACK_VARYINGS, words, 3, names, size);
+		heap_free(names);
+	}
+	g_cap->real->glTransformFeedbackVaryings(program, count, varyings, bufferMode);
+}
+
+static void rec_glBeginTransformFeedback(GLenum primitiveMode)
+{
+	g_cap->real->glBeginTransformFeedback(primitiveMode);
+	uint32_t words[1] = { primitiveMode };
+	write_record(CAPTURE_OP_BEGIN_TRANSFORM_FEEDBACK, words, 1, NULL, 0);
+}
+
+static void rec_glEndTransformFeedback(void)
+{
+	g_cap->real->glEndTransformFeedback();
+	write_record(CAPTURE_OP_END_TRANSFORM_FEEDBACK, NULL, 0, NULL, 0);
+}
+
+static void rec_glGenTextures(GLsizei n, GLuint *textures)
+{
+	g_cap->real->glGenTextures(n, textures);
+	uint32_t words[1] = { n };
+	write_record(CAPTURE_OP_GEN_TEXTURES, words, 1, textures, n * sizeof(GLuint));
+}
+
+static void rec_glDeleteTextures(GLsizei n, const GLuint *textures)
+{
+	g_cap->real->glDeleteTextures(n, textures);
+	uint32_t words[1] = { n };
+	write_record(CAPTURE_OP_DELETE_TEXTURES, words, 1, textures, n * sizeof(GLuint));
+}
+
+static void rec_glActiveTexture(GLenum texture)
+{
+	g_cap->real->glActiveTexture(texture);
+	uint32_t words[1] = { texture };
+	write_record(CAPTURE_OP_ACTIVE_TEXTURE, words, 1, NULL, 0);
+}
+
+static void rec_glBindTexture(GLenum target, GLuint texture)
+{
+	g_cap->real->glBindTexture(target, texture);
+	uint32_t words[2] = { target, texture };
+	write_record(CAPTURE_OP_BIND_TEXTURE, words, 2, NULL, 0);
+}
+
+static void rec_glTexStorage2D(GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height)
+{
+	g_cap->real->glTexStorage2D(target, levels, internalformat, width, height);
+	uint32_t words[5] = { target, levels, internalformat, width, height };
+	write_record(CAPTURE_OP_TEX_STORAGE_2D, words, 5, NULL, 0);
+}
+
+static void rec_glTexParameteri(GLenum target, GLenum pname, GLint param)
+{
+	g_cap->real->glTexParameteri(target, pname, param);
+	uint32_t words[3] = { target, pname, param };
+	write_record(CAPTURE_OP_TEX_PARAMETERI, words, 3, NULL, 0);
+}
+
+static void rec_glGenFramebuffers(GLsizei n, GLuint *framebuffers)
+{
+	g_cap->real->glGenFramebuffers(n, framebuffers);
+	uint32_t words[1] = { n };
+	write_record(CAPTURE_OP_GEN_FRAMEBUFFERS, words, 1, framebuffers, n * sizeof(GLuint));
+}
+
+static void rec_glDeleteFramebuffers(GLsizei n, const GLuint *framebuffers)
+{
+	g_cap->real->glDeleteFramebuffers(n, framebuffers);
+	uint32_t words[1] = { n };
+	write_record(CAPTURE_OP_DELETE_FRAMEBUFFERS, words, 1, framebuffers, n * sizeof(GLuint));
+}
+
+static void rec_glBindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	g_cap->real->glBindFramebuffer(target, framebuffer);
+	uint32_t words[2] = { target, framebuffer };
+	write_record(CAPTURE_OP_BIND_FRAMEBUFFER, words, 2, NULL, 0);
+}
+
+static void rec_glFramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level)
+{
+	g_cap->real->glFramebufferTexture2D(target, attachment, textarget, texture, level);
+	uint32_t words[5] = { target, attachment, textarget, texture, level };
+	write_record(CAPTURE_OP_FRAMEBUFFER_TEXTURE_2D, words, 5, NULL, 0);
+}
+
+static void rec_glBlitFramebuffer(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0,
+		GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter)
+{
+	g_cap->real->glBlitFramebuffer(srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter);
+	uint32_t words[10] = { srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter };
+	write_record(CAPTURE_OP_BLIT_FRAMEBUFFER, words, 10, NULL, 0);
+}
+
+static void rec_glDrawArrays(GLenum mode, GLint first, GLsizei count)
+{
+	write_client_attribs(first, count);
+	g_cap->real->glDrawArrays(mode, first, count);
+	uint32_t words[3] = { mode, first, count };
+	write_record(CAPTURE_OP_DRAW_ARRAYS, words, 3, NULL, 0);
+}
+
+static void rec_glDrawElements(GLenum mode, GLsizei count, GLenum type, const void *indices)
+{
+	GLint element_buffer = 0;
+	g_cap->real->glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &element_buffer);
+
+	if (element_buffer == 0) {
+		/* Client indices: the referenced vertex range comes from the index data */
+		GLuint max_index = 0;
+		for (int i = 0; i < count; ++i) {
+			GLuint index = (type == GL_UNSIGNED_BYTE) ? ((const GLubyte *)indices)[i] :
+					(type == GL_UNSIGNED_SHORT) ? ((const GLushort *)indices)[i] : ((const GLuint *)indices)[i];
+			if (index > max_index) {
+				max_index = index;
+			}
+		}
+		write_client_attribs(0, count ? max_index + 1 : 0);
+	} else {
+		for (int i = 0; i < CAPTURE_MAX_ATTRIBS; ++i) {
+			if (g_cap->attribs[i].enabled && g_cap->attribs[i].client) {
+				dlog_print(DLOG_WARN, LOG_TAG, "capture: client vertex array %d with an element buffer is not recorded", i);
+			}
+		}
+	}
+	g_cap->real->glDrawElements(mode, count, type, indices);
+
+	uint32_t words[5] = { mode, count, type, element_buffer == 0, (uint32_t)(uintptr_t)indices };
+	if (element_buffer == 0) {
+		write_record(CAPTURE_OP_DRAW_ELEMENTS, words, 5, indices, count * type_size(type));
+	} else {
+		write_record(CAPTURE_OP_DRAW_ELEMENTS, words, 5, NULL, 0);
+	}
+}
+
+static void rec_glFlush(void)
+{
+	g_cap->real->glFlush();
+	write_record(CAPTURE_OP_FLUSH, NULL, 0, NULL, 0);
+}
+
+Eina_Bool capture_begin(capture_s *cap, const char *path, int frames)
+{
+	if (g_cap || !__evas_gl_glapi) {
+		return EINA_FALSE;
+	}
+
+	memset(cap, 0, sizeof(*cap));
+	cap->file = fopen(path, "wb");
+	if (!cap->file) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "capture: cannot open %s", path);
+		return EINA_FALSE;
+	}
+	/* Attribute data dominates the stream, keep the writes large */
+	setvbuf(cap->file, NULL, _IOFBF, 1 << 20);
+
+	capture_file_header_s header = { CAPTURE_MAGIC, CAPTURE_VERSION, 0, 0 };
+	fwrite(&header, sizeof(header), 1, cap->file);
+
+	cap->frame_limit = frames;
+	cap->real = __evas_gl_glapi;
+	cap->active = EINA_TRUE;
+	g_cap = cap;
+
+	/* Calls that are not recorded go straight to the driver */
+	g_record_api = *cap->real;
+	g_record_api.glCreateShader = rec_glCreateShader;
+	g_record_api.glShaderSource = rec_glShaderSource;
+	g_record_api.glCompileShader = rec_glCompileShader;
+	g_record_api.glDeleteShader = rec_glDeleteShader;
+	g_record_api.glCreateProgram = rec_glCreateProgram;
+	g_record_api.glAttachShader = rec_glAttachShader;
+	g_record_api.glLinkProgram = rec_glLinkProgram;
+	g_record_api.glDeleteProgram = rec_glDeleteProgram;
+	g_record_api.glGetUniformLocation = rec_glGetUniformLocation;
+	g_record_api.glUseProgram = rec_glUseProgram;
+	g_record_api.glUniform1f = rec_glUniform1f;
+	g_record_api.glUniform1i = rec_glUniform1i;
+	g_record_api.glUniform3fv = rec_glUniform3fv;
+	g_record_api.glUniform4fv = rec_glUniform4fv;
+	g_record_api.glClearColor = rec_glClearColor;
+	g_record_api.glClear = rec_glClear;
+	g_record_api.glViewport = rec_glViewport;
+	g_record_api.glEnable = rec_glEnable;
+	g_record_api.glDisable = rec_glDisable;
+	g_record_api.glBlendFunc = rec_glBlendFunc;
+	g_record_api.glDepthFunc = rec_glDepthFunc;
+	g_record_api.glDepthMask = rec_glDepthMask;
+	g_record_api.glEnableVertexAttribArray = rec_glEnableVertexAttribArray;
+	g_record_api.glDisableVertexAttribArray = rec_glDisableVertexAttribArray;
+	g_record_api.glVertexAttribPointer = rec_glVertexAttribPointer;
+	g_record_api.glGenBuffers = rec_glGenBuffers;
+	g_record_api.glDeleteBuffers = rec_glDeleteBuffers;
+	g_record_api.glBindBuffer = rec_glBindBuffer;
+	g_record_api.glBufferData = rec_glBufferData;
+	g_record_api.glBufferSubData = rec_glBufferSubData;
+	g_record_api.glMapBufferRange = rec_glMapBufferRange;
+	g_record_api.glUnmapBuffer = rec_glUnmapBuffer;
+	g_record_api.glCopyBufferSubData = rec_glCopyBufferSubData;
+	g_record_api.glGetUniformBlockIndex = rec_glGetUniformBlockIndex;
+	g_record_api.glUniformBlockBinding = rec_glUniformBlockBinding;
+	g_record_api.glBindBufferRange = rec_glBindBufferRange;
+	g_record_api.glBindBufferBase = rec_glBindBufferBase;
+	g_record_api.glTransformFeedbackVaryings = rec_glTransformFeedbackVaryings;
+	g_record_api.glBeginTransformFeedback = rec_glBeginTransformFeedback;
+	g_record_api.glEndTransformFeedback = rec_glEndTransformFeedback;
+	g_record_api.glGenTextures = rec_glGenTextures;
+	g_record_api.glDeleteTextures = rec_glDeleteTextures;
+	g_record_api.glActiveTexture = rec_glActiveTexture;
+	g_record_api.glBindTexture = rec_glBindTexture;
+	g_record_api.glTexStorage2D = rec_glTexStorage2D;
+	g_record_api.glTexParameteri = rec_glTexParameteri;
+	g_record_api.glGenFramebuffers = rec_glGenFramebuffers;
+	g_record_api.glDeleteFramebuffers = rec_glDeleteFramebuffers;
+	g_record_api.glBindFramebuffer = rec_glBindFramebuffer;
+	g_record_api.glFramebufferTexture2D = rec_glFramebufferTexture2D;
+	g_record_api.glBlitFramebuffer = rec_glBlitFramebuffer;
+	g_record_api.glDrawArrays = rec_glDrawArrays;
+	g_record_api.glDrawElements = rec_glDrawElements;
+	g_record_api.glFlush = rec_glFlush;
+	__evas_gl_glapi = &g_record_api;
+
+	dlog_print(DLOG_INFO, LOG_TAG, "capture: recording %d frames to %s", frames, path);
+	return EINA_TRUE;
+}
+
+void capture_frame_begin(capture_s *cap)
+{
+	if (!cap->active) {
+		return;
+	}
+	uint32_t words[1] = { cap->frame };
+	write_record(CAPTURE_OP_FRAME_BEGIN, words, 1, NULL, 0);
+}
+
+void capture_frame_end(capture_s *cap)
+{
+	if (!cap->active) {
+		return;
+	}
+	uint32_t words[1] = { cap->frame };
+	write_record(CAPTURE_OP_FRAME_END, words, 1, NULL, 0);
+	if (++cap->frame >= cap->frame_limit) {
+		capture_end(cap);
+	}
+}
+
+void capture_end(capture_s *cap)
+{
+	if (!cap->active) {
+		return;
+	}
+	__evas_gl_glapi = cap->real;
+	g_cap = NULL;
+	cap->active = EINA_FALSE;
+
+	/* The END record carries the call counts so builds can be compared without replaying */
+	cap->counts[CAPTURE_OP_END]++;
+	capture_record_header_s end = { CAPTURE_OP_END, 0, sizeof(cap->counts) };
+	fwrite(&end, sizeof(end), 1, cap->file);
+	fwrite(cap->counts, sizeof(cap->counts), 1, cap->file);
+
+	capture_file_header_s header = { CAPTURE_MAGIC, CAPTURE_VERSION, cap->frame, 0 };
+	fseek(cap->file, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, cap->file);
+	fclose(cap->file);
+	cap->file = NULL;
+
+	dlog_print(DLOG_INFO, LOG_TAG, "capture: recorded %d frames", cap->frame);
+	for (int op = 1; op < CAPTURE_OP_COUNT; ++op) {
+		if (cap->counts[op]) {
+			dlog_print(DLOG_INFO, LOG_TAG, "capture: %-30s %u", capture_op_name(op), cap->counts[op]);
+		}
+	}
+}
@@ -0,0 +1,101 @@
+/*
+ * cmdlist.c
+ *
+ * Deferred GL command lists, see cmdlist.h.
+ */
+
+#include "cmdlist.h"
+
+#include "openes_particalsystem.h"
+#include <Elementary_GL_Helpers.h>
+
+ELEMENTARY_GLVIEW_GLOBAL_DECLARE();
+
+void cmdlist_init(cmdlist_s *list, cmd_s *storage, int capacity)
+{
+	list->commands = storage;
+	list->count = 0;
+	list->capacity = storage ? capacity : 0;
+	list->dropped = 0;
+}
+
+static cmd_s *record(cmdlist_s *list, cmd_op_e op)
+{
+	if (list->count >= list->capacity) {
+		list->dropped++;
+		return NULL;
+	}
+	cmd_s *cmd = &list->commands[list->count++];
+	cmd->op = op;
+	return cmd;
+}
+
+void cmdlist_buffer_sub_data(cmdlist_s *list, GLenum target, GLuint buffer, GLintptr offset, GLsizeiptr size,
+		const void *data)
+{
+	cmd_s *cmd = record(list, CMD_BUFFER_SUB_DATA);
+	if (cmd) {
+		cmd->target = target;
+		cmd->buffer = buffer;
+		cmd->offset = offset;
+		cmd->size = size;
+		cmd->data = data;
+	}
+}
+
+void cmdlist_bind_buffer_range(cmdlist_s *list, GLenum target, GLuint index, GLuint buffer, GLintptr offset,
+		GLsizeiptr size)
+{
+	cmd_s *cmd = record(list, CMD_BIND_BUFFER_RANGE);
+	if (cmd) {
+		cmd->target = target;
+		cmd->index = index;
+		cmd->buffer = buffer;
+		cmd->offset = offset;
+		cmd->size = size;
+	}
+}
+
+void cmdlist_draw_arrays(cmdlist_s *list, GLenum mode, GLint first, GLsizei count)
+{
+	cmd_s *cmd = record(list, CMD_DRAW_ARRAYS);
+	if (cmd) {
+		cmd->target = mode;
+		cmd->first = first;
+		cmd->count = count;
+	}
+}
+
+int cmdlist_submit(const cmdlist_s *lists, int listCount)
+{
+	GLuint boundArray = 0;
+	int executed = 0;
+
+	for (int l = 0; l < listCount; ++l) {
+		const cmdlist_s *list = &lists[l];
+		for (int i = 0; i < list->count; ++i) {
+			const cmd_s *cmd = &list->commands[i];
+			switch (cmd->op) {
+			case CMD_BUFFER_SUB_DATA:
+				/* Consecutive uploads to one buffer share the bind */
+				if (cmd->target != GL_ARRAY_BUFFER || cmd->buffer != boundArray) {
+					glBindBuffer(cmd->target, cmd->buffer);
+					boundArray = (cmd->target == GL_ARRAY_BUFFER) ? cmd->buffer : boundArray;
+				}
+				glBufferSubData(cmd->target, cmd->offset, cmd->size, cmd->data);
+				break;
+			case CMD_BIND_BUFFER_RANGE:
+				glBindBufferRange(cmd->target, cmd->index, cmd->buffer, cmd->offset, cmd->size);
+				break;
+			case CMD_DRAW_ARRAYS:
+				glDrawArrays(cmd->target, cmd->first, cmd->count);
+				break;
+			}
+			executed++;
+		}
+	}
+	if (boundArray) {
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	return executed;
+}
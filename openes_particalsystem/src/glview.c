@@ -6,6 +6,11 @@
  */
 
 #include "glview.h"
+#include "golden.h"
+#include "uniforms.h"
+#include <limits.h>
+#include <string.h>
+#include <time.h>
 
 /*
  * The file Elementary_GL_Helpers.h provies some convenience functions
@@ -20,81 +25,279 @@
  */
 ELEMENTARY_GLVIEW_GLOBAL_DEFINE();
 
+/*
+ * @brief Build the path of a file in the app data directory
+ * @param[out] path output buffer
+ * @param[in] size size of the output buffer
+ * @param[in] name file name
+ */
+static void data_file_path(char *path, size_t size, const char *name)
+{
+	char *data_path = app_get_data_path();
+	snprintf(path, size, "%s%s", data_path ? data_path : "", name);
+	free(data_path);
+}
 
-static GLuint LoadShader(GLenum type, const char *shaderSrc)
+/* Vertex Shader Source */
+static const char vShaderStr[] =
+		"#version 300 es\n"
+		FRAME_PARAMS_BLOCK
+		EMITTER_PARAMS_BLOCK
+		"layout(location = 0) in float a_lifetime;\n"
+		"layout(location = 3) in vec3 a_position;\n"
+		"out float v_lifetime;\n"
+		"out float v_alpha;\n"
+		"#ifdef SOFT_PARTICLES\n"
+		"uniform highp sampler2D u_sceneDepth;\n"
+		"#endif\n"
+		"void main()\n"
+		"{\n"
+		"  if (u_time <= a_lifetime) {\n"
+		"    gl_Position = vec4(a_position, 1.0);\n"
+		"  } else {\n"
+		"    gl_Position = vec4(0, 0, 0, 0);\n"
+		"  }\n"
+		"  v_lifetime = 1.0 - (u_time/a_lifetime);\n"
+		"  v_lifetime = clamp(v_lifetime, 0.0, 1.0);\n"
+		"  gl_PointSize = (v_lifetime * v_lifetime)*" XSTR(LOD_POINT_SIZE) "*u_lod.z;\n"
+		"#ifdef LOD_FADE\n"
+		"  // the last particles of the LOD count fade out\n"
+		"  v_alpha = clamp((u_lod.x - float(gl_VertexID)) / u_lod.y, 0.0, 1.0) * u_lod.w;\n"
+		"#else\n"
+		"  v_alpha = u_lod.w;\n"
+		"#endif\n"
+		"#ifdef SOFT_PARTICLES\n"
+		"  // drop a point the scene hides at its center and corners before it is rasterized,\n"
+		"  // depth 1.0 is the clear value and means no geometry there\n"
+		"  if (gl_Position.w > 0.0) {\n"
+		"    vec2 uv = (gl_Position.xy * 0.5 + 0.5) * u_viewport.xy * u_depth.xy;\n"
+		"    vec2 r = 0.5 * gl_PointSize * u_depth.xy;\n"
+		"    float scene = textureLod(u_sceneDepth, uv, 0.0).r;\n"
+		"    scene = max(scene, textureLod(u_sceneDepth, uv - r, 0.0).r);\n"
+		"    scene = max(scene, textureLod(u_sceneDepth, uv + r, 0.0).r);\n"
+		"    scene = max(scene, textureLod(u_sceneDepth, uv + vec2(r.x, -r.y), 0.0).r);\n"
+		"    scene = max(scene, textureLod(u_sceneDepth, uv + vec2(-r.x, r.y), 0.0).r);\n"
+		"    if (scene < 1.0 && gl_Position.z * 0.5 + 0.5 > scene)\n"
+		"      gl_Position = vec4(0, 0, 0, 0);\n"
+		"  }\n"
+		"#endif\n"
+		"}";
+
+/* Fragment Shader Source */
+static const char fShaderStr[] =
+		"#version 300 es\n"
+		"precision mediump float;\n"
+		EMITTER_PARAMS_BLOCK
+		"#ifdef SOFT_PARTICLES\n"
+		FRAME_PARAMS_BLOCK
+		"uniform highp sampler2D u_sceneDepth;\n"
+		"#endif\n"
+		"in float v_lifetime;\n"
+		"in float v_alpha;\n"
+		"out vec4 fragColor;\n"
+		"void main()\n"
+		"{\n"
+		"#ifdef ROUND_POINTS\n"
+		"  if(length(gl_PointCoord - vec2(0.5))>0.5)\n"
+		"    discard;\n"
+		"#endif\n"
+		"  fragColor = u_color;\n"
+		"  fragColor.a *= v_lifetime * v_alpha;\n"
+		"#ifdef SOFT_PARTICLES\n"
+		"  // fade out where the particle meets opaque geometry, not over the empty background\n"
+		"  highp float scene = texture(u_sceneDepth, gl_FragCoord.xy * u_depth.xy).r;\n"
+		"  if (scene < 1.0)\n"
+		"    fragColor.a *= clamp((scene - gl_FragCoord.z) * u_depth.z, 0.0, 1.0);\n"
+		"#endif\n"
+		"}";
+
+/* Macros of the draw_features_e bits, in bit order */
+static const char * const draw_features[] = { "ROUND_POINTS", "LOD_FADE", "SOFT_PARTICLES" };
+
+static const variant_block_s draw_blocks[] = {
+	{ "FrameParams", FRAME_PARAMS_BINDING },
+	{ "EmitterParams", EMITTER_PARAMS_BINDING },
+};
+
+static const variant_family_s draw_family = {
+	.label = "draw program",
+	.vertex = vShaderStr,
+	.fragment = fShaderStr,
+	.features = draw_features,
+	.feature_count = sizeof(draw_features) / sizeof(draw_features[0]),
+	.blocks = draw_blocks,
+	.block_count = sizeof(draw_blocks) / sizeof(draw_blocks[0]),
+};
+
+#ifdef PARTICLE_SOFT
+/*
+ * Opaque colliders. The depth pre-pass and the color pass must produce the
+ * same depth for GL_EQUAL to pass, hence the invariant position.
+ */
+static const char vSceneShaderStr[] =
+		"#version 300 es\n"
+		"layout(location = " XSTR(SCENE_POSITION_ATTRIB) ") in vec3 a_scenePosition;\n"
+		"layout(location = " XSTR(SCENE_NORMAL_ATTRIB) ") in vec3 a_sceneNormal;\n"
+		"invariant gl_Position;\n"
+		"#ifndef DEPTH_ONLY\n"
+		"out float v_shade;\n"
+		"#endif\n"
+		"void main()\n"
+		"{\n"
+		"  gl_Position = vec4(a_scenePosition, 1.0);\n"
+		"#ifndef DEPTH_ONLY\n"
+		"  v_shade = 0.3 + 0.7 * max(dot(a_sceneNormal, normalize(vec3(-0.4, 0.6, -0.7))), 0.0);\n"
+		"#endif\n"
+		"}";
+
+static const char fSceneShaderStr[] =
+		"#version 300 es\n"
+		"precision mediump float;\n"
+		"#ifndef DEPTH_ONLY\n"
+		"in float v_shade;\n"
+		"out vec4 fragColor;\n"
+		"#endif\n"
+		"void main()\n"
+		"{\n"
+		"#ifndef DEPTH_ONLY\n"
+		"  fragColor = vec4(vec3(0.35, 0.35, 0.4) * v_shade, 1.0);\n"
+		"#endif\n"
+		"}";
+
+#define SCENE_DEPTH_ONLY (1 << 0)
+
+static const char * const scene_features[] = { "DEPTH_ONLY" };
+
+static const variant_family_s scene_family = {
+	.label = "scene program",
+	.vertex = vSceneShaderStr,
+	.fragment = fSceneShaderStr,
+	.features = scene_features,
+	.feature_count = sizeof(scene_features) / sizeof(scene_features[0]),
+};
+#endif
+
+/*
+ * @brief Fill the force list: gravity and drag, a weak attractor in the
+ *        middle, some turbulence, a floor and a sphere to bounce off
+ */
+static void init_forces(simulation_s *sim)
 {
-	GLuint shader;
-	GLint compiled;
-	// Create the shader object
-	shader = glCreateShader(type);
-	if (shader == 0) {
-		return 0;
-	}
-	// Load the shader source
-	glShaderSource(shader, 1, &shaderSrc, NULL);
-	// Compile the shader
-	glCompileShader(shader);
-	// Check the compile status
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-	if (!compiled) {
-		GLint infoLen = 0;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
-		if (infoLen > 1) {
-			char *infoLog = malloc(sizeof(char) * infoLen);
-			glGetShaderInfoLog(shader, infoLen, NULL, infoLog);
-			dlog_print(DLOG_ERROR, LOG_TAG, "Error compiling shader:\n%s\n", infoLog);
-			free(infoLog);
-		}
-		glDeleteShader(shader);
-		return 0;
+	const particle_force_s forces[] = {
+		{ { PARTICLE_FORCE_GRAVITY, 0.6f, 0.0f, 0.0f }, { 0.0f, -1.0f, 0.0f, 0.0f } },
+		{ { PARTICLE_FORCE_DRAG, 0.3f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+		{ { PARTICLE_FORCE_ATTRACTOR, 0.05f, 0.2f, 0.0f }, { 0.0f, 0.3f, 0.0f, 0.0f } },
+		{ { PARTICLE_FORCE_TURBULENCE, 0.4f, 3.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 0.0f } },
+		{ { PARTICLE_COLLIDER_PLANE, 0.0f, 0.5f, 0.2f }, { 0.0f, 1.0f, 0.0f, -0.8f } },
+		{ { PARTICLE_COLLIDER_SPHERE, 0.0f, 0.6f, 0.1f }, { 0.4f, -0.5f, 0.0f, 0.2f } },
+	};
+
+	sim->force_count = 0;
+	for (size_t i = 0; i < sizeof(forces) / sizeof(forces[0]); ++i) {
+		simulation_add_force(sim, &forces[i]);
 	}
-	return shader;
 }
 
 /*
- * @brief create sharder program
+ * @brief Copy the scene state that goes with the current particle state
  */
-static GLuint CreateProgram(const char *vertexShaderSrc, const char *fragmentShaderSrc)
+static void capture_scene(appdata_s *ad, scene_state_s *scene)
 {
-	/* Load the vertex/fragment shaders */
-	GLuint vertexShader = LoadShader(GL_VERTEX_SHADER, vertexShaderSrc);
-	if (vertexShader == 0) {
-		return 0;
-	}
-	GLuint fragmentShader = LoadShader(GL_FRAGMENT_SHADER, fragmentShaderSrc);
-	if (fragmentShader == 0) {
-		return 0;
-	}
-	/* Create the program object */
-	GLuint program = glCreateProgram();
-	if (program == 0) {
-		return 0;
-	}
-	glAttachShader(program, vertexShader);
-	glAttachShader(program, fragmentShader);
-
-	// Link the program
-	glLinkProgram(program);
-	// Check the link status
-	GLint linked;
-	glGetProgramiv(program, GL_LINK_STATUS, &linked);
-	if (!linked) {
-		GLint infoLen = 0;
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLen);
-		if (infoLen > 1) {
-			char *infoLog = malloc(sizeof(char) * infoLen);
-			glGetProgramInfoLog(program, infoLen, NULL, infoLog);
-			dlog_print(DLOG_ERROR, LOG_TAG, "Error linking program:\n%s\n", infoLog);
-			free(infoLog);
-		}
-		glDeleteProgram(program);
-		return 0;
+	for (int i = 0; i < NUM_EMITTERS; ++i) {
+		const emitter_s *emitter = &ad->emitters[i];
+		snapshot_emitter_s *saved = &scene->emitters[i];
+		memset(saved, 0, sizeof(*saved));
+		memcpy(saved->center, emitter->center, sizeof(saved->center));
+		memcpy(saved->color, emitter->color, sizeof(saved->color));
+		saved->time = emitter->time;
+		saved->burst = emitter->burst;
 	}
+	scene->time = ad->time;
+	scene->rng = ad->rng;
+	scene->frame = ad->frame;
+}
 
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
-	return program;
+/*
+ * @brief Map the snapshot file if it was written by a build with the same
+ *        particle layout
+ * @return EINA_TRUE if <snapshot> is mapped
+ */
+static Eina_Bool open_snapshot(snapshot_s *snapshot)
+{
+#ifdef PARTICLE_DETERMINISTIC
+	(void)snapshot;
+	return EINA_FALSE;
+#else
+	char path[PATH_MAX];
+	data_file_path(path, sizeof(path), SNAPSHOT_FILE_NAME);
+	if (snapshot_map(snapshot, path) != 0) {
+		return EINA_FALSE;
+	}
+	const snapshot_header_s *header = snapshot->header;
+	if (header->particle_count != NUM_PARTICLES || header->emitter_count != NUM_EMITTERS ||
+			header->particle_size != PARTICLE_SIZE || header->state_size != PARTICLE_STATE_SIZE) {
+		dlog_print(DLOG_WARN, LOG_TAG, "snapshot: %s is for %u emitters of %u particles, ignored",
+				path, header->emitter_count, header->particle_count);
+		snapshot_unmap(snapshot);
+		return EINA_FALSE;
+	}
+	return EINA_TRUE;
+#endif
 }
+
+/*
+ * @brief Start a GPU readback every SNAPSHOT_READBACK_FRAMES frames and keep
+ *        the finished ones for the next snapshot
+ */
+static void update_readback(appdata_s *ad)
+{
+	if (!ad->snapshot.buffer) {
+		return;
+	}
+	if (simulation_readback_poll(&ad->sim, ad->saved_state)) {
+		ad->saved_scene = ad->readback_scene;
+		ad->saved_valid = EINA_TRUE;
+	}
+	if (ad->frame % SNAPSHOT_READBACK_FRAMES == 0 && simulation_readback_begin(&ad->sim)) {
+		capture_scene(ad, &ad->readback_scene);
+	}
+}
+
+void glview_save_snapshot(appdata_s *ad)
+{
+	/* No writer in deterministic builds, or before the view is set up */
+	if (!ad->initialized || ad->replay.active || !ad->snapshot.buffer) {
+		return;
+	}
+	/* The CPU path has its current state at hand, the GPU path its last readback */
+	if (ad->sim.path == SIM_PATH_CPU) {
+		capture_scene(ad, &ad->saved_scene);
+		memcpy(ad->saved_state, ad->sim.state, sizeof(ad->saved_state));
+		ad->saved_valid = EINA_TRUE;
+	}
+	if (!ad->saved_valid) {
+		return;
+	}
+
+	snapshot_header_s *header = snapshot_writer_begin(&ad->snapshot);
+	size_t size = snapshot_layout(header, NUM_PARTICLES, NUM_EMITTERS, PARTICLE_SIZE, PARTICLE_STATE_SIZE);
+	header->frame = ad->saved_scene.frame;
+	header->rng = ad->saved_scene.rng.state;
+	header->time = ad->saved_scene.time;
+	char *base = (char *)header;
+	memcpy(base + header->data_offset, ad->particleData, sizeof(ad->particleData));
+	memcpy(base + header->state_offset, ad->saved_state, sizeof(ad->saved_state));
+	memcpy(base + header->emitters_offset, ad->saved_scene.emitters, sizeof(ad->saved_scene.emitters));
+
+	char path[PATH_MAX];
+	data_file_path(path, sizeof(path), SNAPSHOT_FILE_NAME);
+	if (snapshot_write_async(&ad->snapshot, path, size) != 0) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "snapshot: could not write %s", path);
+		return;
+	}
+	dlog_print(DLOG_INFO, LOG_TAG, "snapshot: writing %zu bytes of frame %d", size, ad->saved_scene.frame);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 /*
  * @brief Initializing function of GLView
@@ -106,75 +309,142 @@ static void init_glview(Evas_Object *obj)
 
 	ad->initialized = false;
 
+	if (arena_init(&ad->frame_arena, FRAME_ARENA_SIZE) != 0 ||
+			arena_init(&ad->init_arena, INIT_ARENA_SIZE) != 0) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "arena: out of memory");
+		return;
+	}
+	ad->frame_heap_allocs = 0;
+	gpumem_init(&ad->gpumem, GPUMEM_BUDGET);
+#ifdef PARTICLE_SOFT
+	rtpool_init(&ad->targets, &ad->gpumem, EINA_TRUE);
+#else
+	rtpool_init(&ad->targets, &ad->gpumem, EINA_FALSE);
+#endif
+	variants_init(&ad->shaders, &ad->init_arena, &ad->gpumem);
+
+	if (jobs_init(&ad->jobs, SIM_JOB_THREADS) != 0) {
+		dlog_print(DLOG_WARN, LOG_TAG, "jobs: no worker threads, running jobs on the GL thread");
+	}
+
+#if defined(CAPTURE_REPLAY) || defined(CAPTURE_FRAMES)
+	char capture_path[PATH_MAX];
+	data_file_path(capture_path, sizeof(capture_path), CAPTURE_FILE_NAME);
+#endif
+#ifdef CAPTURE_REPLAY
+	/* The recorded setup replaces the particle system */
+	if (replay_open(&ad->replay, capture_path)) {
+		ad->initialized = EINA_TRUE;
+		return;
+	}
+#endif
+#ifdef CAPTURE_FRAMES
+	/* Start before any GL object is created so the capture can be replayed on its own */
+	capture_begin(&ad->capture, capture_path, CAPTURE_FRAMES);
+#endif
+
 	if (!ad->initialized) {
-		/* Vertex Shader Source */
-		const char vShaderStr[] =
-				"#version 300 es\n"
-				"uniform float u_time;\n"
-				"uniform vec3 u_centerPosition;\n"
-				"layout(location = 0) in float a_lifetime;\n"
-				"layout(location = 1) in vec3 a_startPosition;\n"
-				"layout(location = 2) in vec3 a_endPosition;\n"
-				"out float v_lifetime;\n"
-				"void main()\n"
-				"{\n"
-				"  if (u_time <= a_lifetime) {\n"
-				"    gl_Position.xyz = a_startPosition + (u_time * a_endPosition);\n"
-				"    gl_Position.xyz += u_centerPosition;\n"
-				"    gl_Position.w = 1.0;\n"
-				"  } else {\n"
-				"    gl_Position = vec4(0, 0, 0, 0);\n"
-				"  }\n"
-				"  v_lifetime = 1.0 - (u_time/a_lifetime);\n"
-				"  v_lifetime = clamp(v_lifetime, 0.0, 1.0);\n"
-				"  gl_PointSize = (v_lifetime * v_lifetime)*40.0;\n"
-				"}";
-
-		/* Fragment Shader Source */
-		const char fShaderStr[] =
-				"#version 300 es\n"
-				"precision mediump float;\n"
-				"uniform vec4 u_color;\n"
-				"in float v_lifetime;\n"
-				"out vec4 fragColor;"
-				"\n"
-				"void main()\n"
-				"{\n"
-				"  if(length(gl_PointCoord - vec2(0.5))>0.5)\n"
-				"    discard;\n"
-				"  fragColor = u_color;\n"
-				"  fragColor.a *= v_lifetime;\n"
-				"}";
-
-		ad->program = CreateProgram(vShaderStr, fShaderStr);
-		if (ad->program == 0) {
+		// every LOD variant of the draw mode can be picked by the first frames, build them now
+#ifdef PARTICLE_SOFT
+		const variant_features_t mode = DRAW_SOFT;
+		const variant_features_t sceneSet[] = { SCENE_DEPTH_ONLY, 0 };
+		if (variants_prewarm(&ad->shaders, &scene_family, sceneSet, 2) != 2) {
+			return;
+		}
+#else
+		const variant_features_t mode = 0;
+#endif
+		variant_features_t set[DRAW_LOD_MASK + 1];
+		for (int i = 0; i <= DRAW_LOD_MASK; ++i) {
+			set[i] = i | mode;
+		}
+		if (variants_prewarm(&ad->shaders, &draw_family, set, DRAW_LOD_MASK + 1) != DRAW_LOD_MASK + 1) {
 			return;
 		}
 
-		// get the uniform location
-		ad->timeLoc = glGetUniformLocation(ad->program, "u_time");
-		ad->centerPositionLoc = glGetUniformLocation(ad->program, "u_centerPosition");
-		ad->colorLoc = glGetUniformLocation(ad->program, "u_color");
-
-		// Fill in particle data array
-		srand(0);
-
-		for (int i = 0; i < NUM_PARTICLES; ++i) {
-			float *particleData = &ad->particleData[i * PARTICLE_SIZE];
-			// lifetime of particle
-			(*particleData++) = ((float)(rand() % 10000)/10000.0f);
-			// end position of particle
-			(*particleData++) = ((float)(rand() % 10000)/5000.0f) - 1.0f;
-			(*particleData++) = ((float)(rand() % 10000)/5000.0f) - 1.0f;
-			(*particleData++) = ((float)(rand() % 10000)/5000.0f) - 1.0f;
-			// start position of particle
-			(*particleData++) = ((float)(rand() % 10000)/40000.0f) - 0.125f;
-			(*particleData++) = ((float)(rand() % 10000)/40000.0f) - 0.125f;
-			(*particleData++) = ((float)(rand() % 10000)/40000.0f) - 0.125f;
+		// frame, force and emitter blocks; the force block is the largest
+		if (!ubo_ring_init(&ad->ubo, 2 + NUM_EMITTERS, sizeof(force_params_s))) {
+			return;
+		}
+		gpumem_track(&ad->gpumem, GPUMEM_BUFFER, ad->ubo.buffer, ad->ubo.slice_size * UBO_RING_SLICES,
+				"uniform ring", NULL, NULL);
+
+		// Fill in particle data array, or take it from the last snapshot
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		snapshot_s snapshot;
+		Eina_Bool restored = open_snapshot(&snapshot);
+		if (restored) {
+			memcpy(ad->particleData, snapshot.data, sizeof(ad->particleData));
+		} else {
+			particle_rng_seed(&ad->rng, PARTICLE_SEED);
+			particles_init(ad->particleData, NUM_PARTICLES, &ad->rng);
+		}
+
+		// the particle data never changes, keep it on the GPU
+		glGenBuffers(1, &ad->vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, ad->vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(ad->particleData), restored ? snapshot.data : ad->particleData,
+				GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		gpumem_track(&ad->gpumem, GPUMEM_BUFFER, ad->vbo, sizeof(ad->particleData), "particle data", NULL, NULL);
+
+		// stagger the emitters so their bursts do not line up
+		for (int i = 0; i < NUM_EMITTERS; ++i) {
+			ad->emitters[i].time = 1.0f - (float)i / NUM_EMITTERS;
+			ad->emitters[i].burst = EINA_FALSE;
+			lod_init(&ad->emitters[i].lod, ad->particleData, NUM_PARTICLES);
+		}
+		ad->time = 0.0f;
+		ad->frame = 0;
+
+		// continue the saved scene where it was
+		if (restored) {
+			for (int i = 0; i < NUM_EMITTERS; ++i) {
+				const snapshot_emitter_s *saved = &snapshot.emitters[i];
+				memcpy(ad->emitters[i].center, saved->center, sizeof(saved->center));
+				memcpy(ad->emitters[i].color, saved->color, sizeof(saved->color));
+				ad->emitters[i].time = saved->time;
+				ad->emitters[i].burst = saved->burst != 0;
+			}
+			ad->time = snapshot.header->time;
+			ad->rng.state = snapshot.header->rng;
+			ad->frame = snapshot.header->frame;
+		}
+		ad->first_frame = ad->frame;
+
+		init_forces(&ad->sim);
+#ifdef PARTICLE_SOFT
+		if (!scene_init(&ad->scene, ad->sim.forces, ad->sim.force_count, &ad->gpumem)) {
+			if (restored) {
+				snapshot_unmap(&snapshot);
+			}
+			return;
+		}
+#endif
+		glview_mark_dirty(ad, DIRTY_UNIFORMS);
+		Eina_Bool simulated = simulation_init(&ad->sim, ad, restored ? snapshot.state : NULL);
+		if (restored) {
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			dlog_print(DLOG_INFO, LOG_TAG, "snapshot: resumed frame %u in %.2f ms", snapshot.header->frame,
+					(end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6);
+			snapshot_unmap(&snapshot);
+		}
+		if (!simulated) {
+			return;
 		}
 
-		ad->time = 1.0f;
+#ifndef PARTICLE_DETERMINISTIC
+		snapshot_header_s layout;
+		if (snapshot_writer_init(&ad->snapshot, snapshot_layout(&layout, NUM_PARTICLES, NUM_EMITTERS,
+				PARTICLE_SIZE, PARTICLE_STATE_SIZE)) != 0) {
+			dlog_print(DLOG_WARN, LOG_TAG, "snapshot: out of memory, the state will not be saved");
+		}
+		ad->saved_valid = EINA_FALSE;
+#endif
 
+		gpumem_report(&ad->gpumem);
+		variants_report(&ad->shaders);
 		ad->initialized = EINA_TRUE;
 	}
 }
@@ -188,7 +458,22 @@ static void del_glview(Evas_Object *obj)
 	appdata_s *ad = evas_object_data_get(obj, "ad");
 
 	/* Release resources. */
-	glDeleteProgram(ad->program);
+	snapshot_writer_destroy(&ad->snapshot);
+	capture_end(&ad->capture);
+	replay_close(&ad->replay);
+	rtpool_destroy(&ad->targets);
+	scene_destroy(&ad->scene, &ad->gpumem);
+	simulation_destroy(&ad->sim, ad);
+	gpumem_untrack(&ad->gpumem, GPUMEM_BUFFER, ad->ubo.buffer);
+	ubo_ring_destroy(&ad->ubo);
+	gpumem_untrack(&ad->gpumem, GPUMEM_BUFFER, ad->vbo);
+	glDeleteBuffers(1, &ad->vbo);
+	variants_destroy(&ad->shaders);
+	/* Whatever is left are evictable caches */
+	gpumem_trim(&ad->gpumem, 0);
+	jobs_shutdown(&ad->jobs);
+	arena_destroy(&ad->frame_arena);
+	arena_destroy(&ad->init_arena);
 
 	evas_object_data_del((Evas_Object*) obj, "ad");
 }
@@ -201,36 +486,226 @@ static void resize_glview(Evas_Object *obj)
 {
 	appdata_s *ad = evas_object_data_get(obj, "ad");
 
+#ifdef GLVIEW_RESIZE_RECREATE
 	/* Get size of GLView object for setting Viewport*/
 	elm_glview_size_get(obj, &ad->glview_w, &ad->glview_h);
+	ad->surface_w = ad->glview_w;
+	ad->surface_h = ad->glview_h;
 
 	glViewport(0, 0, ad->glview_w, ad->glview_h);
+#else
+	/* The surface keeps its size; the scene follows the object */
+	elm_glview_size_get(obj, &ad->surface_w, &ad->surface_h);
+	evas_object_geometry_get(obj, NULL, NULL, &ad->glview_w, &ad->glview_h);
+
+	/* Both orientations are ready before the next rotation */
+	rtpool_prewarm(&ad->targets, ad->glview_w, ad->glview_h);
+#endif
+	glview_mark_dirty(ad, DIRTY_VIEW);
 }
 
 static void Update(appdata_s *ad, float deltaTime)
 {
 	ad->time += deltaTime;
-	//glUseProgram(ad->program);
-	if (ad->time >= 1.0f) {
-		float centerPos[3];
-		float color[4];
-		ad->time = 0.0f;
-		// Pick a new start location and color
-		centerPos[0] = ((float)(rand() % 10000)/10000.0f) - 0.5f;
-		centerPos[1] = ((float)(rand() % 10000)/10000.0f) - 0.5f;
-		centerPos[2] = ((float)(rand() % 10000)/10000.0f) - 0.5f;
-		glUniform3fv(ad->centerPositionLoc, 1, &centerPos[0]);
-
-		// random color
-		color[0] = ((float)(rand() % 10000)/20000.0f) + 0.5f;
-		color[1] = ((float)(rand() % 10000)/20000.0f) + 0.5f;
-		color[2] = ((float)(rand() % 10000)/20000.0f) + 0.5f;
-		color[3] = 0.5f;
-		glUniform4fv(ad->colorLoc, 1, &color[0]);
-	}
-	glUniform1f(ad->timeLoc, ad->time);
+	for (int i = 0; i < NUM_EMITTERS; ++i) {
+		emitter_s *emitter = &ad->emitters[i];
+		emitter->time += deltaTime;
+		emitter->burst = (emitter->time >= 1.0f);
+		if (emitter->burst) {
+			emitter->time = 0.0f;
+			// Pick a new start location and color
+			particles_pick_burst(&ad->rng, emitter->center, emitter->color);
+		}
+		lod_update(&emitter->lod, emitter->center, ad->glview_w, ad->glview_h, deltaTime);
+	}
+}
+
+/*
+ * @brief Write this frame's uniform blocks into the ring in one mapping
+ * @param[in] deltaTime time step of this frame
+ * @param[in] target render target of this frame, or NULL
+ * @param[out] frameOffset offset of the FrameParams block
+ * @param[out] forceOffset offset of the ForceParams block
+ * @param[out] emitterOffsets offsets of the EmitterParams blocks
+ * @return EINA_TRUE if the blocks were written
+ */
+static Eina_Bool UploadParams(appdata_s *ad, float deltaTime, const render_target_s *target, GLintptr *frameOffset,
+		GLintptr *forceOffset, GLintptr emitterOffsets[NUM_EMITTERS])
+{
+	if (!ubo_ring_begin(&ad->ubo)) {
+		return EINA_FALSE;
+	}
+
+	frame_params_s *frame = ubo_ring_alloc(&ad->ubo, sizeof(*frame), frameOffset);
+	frame->viewport[0] = ad->glview_w;
+	frame->viewport[1] = ad->glview_h;
+	frame->viewport[2] = ad->glview_w ? 1.0f / ad->glview_w : 0.0f;
+	frame->viewport[3] = ad->glview_h ? 1.0f / ad->glview_h : 0.0f;
+	frame->frameTime = ad->time;
+	frame->timeStep = deltaTime;
+	// the scene depth texture is the target's allocated size, window depth spans half the NDC range
+	frame->depth[0] = target ? 1.0f / target->bucket_w : 0.0f;
+	frame->depth[1] = target ? 1.0f / target->bucket_h : 0.0f;
+	frame->depth[2] = 2.0f / PARTICLE_SOFT_DISTANCE;
+	frame->depth[3] = 0.0f;
+
+	force_params_s *forces = ubo_ring_alloc(&ad->ubo, sizeof(*forces), forceOffset);
+	simulation_write_forces(&ad->sim, forces);
+
+	for (int i = 0; i < NUM_EMITTERS; ++i) {
+		const emitter_s *emitter = &ad->emitters[i];
+		emitter_params_s *params = ubo_ring_alloc(&ad->ubo, sizeof(*params), &emitterOffsets[i]);
+		memcpy(params->centerPosition, emitter->center, sizeof(emitter->center));
+		params->centerPosition[3] = 1.0f;
+		memcpy(params->color, emitter->color, sizeof(emitter->color));
+		params->time = emitter->time;
+		params->burst = emitter->burst ? 1.0f : 0.0f;
+		lod_uniform(&emitter->lod, params->lod);
+	}
+
+	ubo_ring_end(&ad->ubo);
+	return EINA_TRUE;
 }
 
+/*
+ * @brief Log the arena high-water marks and the heap_alloc() calls made by
+ *        steady-state frames, which should stay at 0. Allocations inside
+ *        EFL and the driver are not counted.
+ */
+static void report_memory(appdata_s *ad)
+{
+	dlog_print(DLOG_INFO, LOG_TAG, "arena: frame peak %zu/%zu bytes, init peak %zu/%zu bytes, %llu failed allocations",
+			ad->frame_arena.peak, ad->frame_arena.capacity, ad->init_arena.peak, ad->init_arena.capacity,
+			(unsigned long long)(ad->frame_arena.failures + ad->init_arena.failures));
+	dlog_print(ad->frame_heap_allocs ? DLOG_WARN : DLOG_INFO, LOG_TAG, "arena: %llu heap_alloc() calls in steady-state frames",
+			(unsigned long long)ad->frame_heap_allocs);
+
+	/* Jobs run per thread since the last report; thread 0 is the GL thread */
+	char line[128];
+	int length = 0;
+	for (int i = 0; i < ad->jobs.thread_count; ++i) {
+		length += snprintf(line + length, sizeof(line) - length, " %d", atomic_exchange(&ad->jobs.executed[i], 0));
+		if (length >= (int)sizeof(line)) {
+			break;
+		}
+	}
+	dlog_print(DLOG_INFO, LOG_TAG, "jobs: %d threads, executed%s, %d stolen", ad->jobs.thread_count, line,
+			atomic_exchange(&ad->jobs.stolen, 0));
+}
+
+/*
+ * @brief Log what each emitter's screen coverage made it draw
+ */
+static void report_lod(appdata_s *ad)
+{
+	for (int i = 0; i < NUM_EMITTERS; ++i) {
+		const lod_s *lod = &ad->emitters[i].lod;
+		dlog_print(DLOG_INFO, LOG_TAG, "lod: emitter %d covers %.0f pixels, draws %d/%d particles, point scale %.2f%s",
+				i, lod->coverage, lod_draw_count(lod), lod->capacity, lod->point_scale, lod->cheap ? ", no discard" : "");
+	}
+}
+
+/*
+ * @brief Log how often frames found their render target in the pool
+ */
+static void report_targets(appdata_s *ad)
+{
+	rtpool_s *pool = &ad->targets;
+	dlog_print(DLOG_INFO, LOG_TAG, "rtpool: view %dx%d on a %dx%d surface, %d reuses, %d allocations (%.2f ms)",
+			ad->glview_w, ad->glview_h, ad->surface_w, ad->surface_h, pool->hits, pool->allocations, pool->allocation_ms);
+	pool->hits = 0;
+	pool->allocations = 0;
+	pool->allocation_ms = 0.0;
+}
+
+#ifdef PARTICLE_GOLDEN_TEST
+/*
+ * @brief Compare the current frame with the golden image for the view size
+ *        and exit. A missing golden image is written to the data directory,
+ *        to be reviewed and copied into res/.
+ */
+static void golden_test(appdata_s *ad)
+{
+	int w = ad->glview_w, h = ad->glview_h;
+	char name[64], path[PATH_MAX];
+	golden_report_s report;
+	uint8_t *pixels = heap_alloc((size_t)w * h * 4);
+
+	if (!pixels) {
+		ui_app_exit();
+		return;
+	}
+	glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+
+	golden_file_name(name, sizeof(name), w, h);
+	char *res_path = app_get_resource_path();
+	snprintf(path, sizeof(path), "%s%s", res_path ? res_path : "", name);
+	free(res_path);
+	golden_compare(path, pixels, w, h, PARTICLE_GOLDEN_TOLERANCE, PARTICLE_GOLDEN_MAX_BAD_RATIO, &report);
+
+	switch (report.result) {
+	case GOLDEN_PASS:
+		dlog_print(DLOG_INFO, LOG_TAG, "golden: PASS %s (%d pixels over tolerance, max diff %d)",
+				name, report.bad_pixels, report.max_diff);
+		break;
+	case GOLDEN_FAIL:
+		dlog_print(DLOG_ERROR, LOG_TAG, "golden: FAIL %s (%d pixels over tolerance, max diff %d)",
+				name, report.bad_pixels, report.max_diff);
+		strncat(name, ".actual", sizeof(name) - strlen(name) - 1);
+		data_file_path(path, sizeof(path), name);
+		golden_write(path, pixels, w, h);
+		break;
+	case GOLDEN_MISSING:
+		data_file_path(path, sizeof(path), name);
+		golden_write(path, pixels, w, h);
+		dlog_print(DLOG_WARN, LOG_TAG, "golden: no %s in res/, wrote %s", name, path);
+		break;
+	}
+	heap_free(pixels);
+	ui_app_exit();
+}
+#endif
+
+#ifdef PARTICLE_SOFT
+/*
+ * @brief Draw the opaque scene into <target> and leave the state for the
+ *        depth tested particle pass: depth test on, depth writes off, the
+ *        scene depth on texture unit 0 (the default of u_sceneDepth)
+ * @return EINA_FALSE if the scene programs are missing, nothing is drawn
+ */
+static Eina_Bool draw_scene(appdata_s *ad, const render_target_s *target)
+{
+	GLuint depthProgram = variants_get(&ad->shaders, &scene_family, SCENE_DEPTH_ONLY);
+	GLuint colorProgram = variants_get(&ad->shaders, &scene_family, 0);
+	if (depthProgram == 0 || colorProgram == 0) {
+		return EINA_FALSE;
+	}
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+
+	// Depth pre-pass: opaque geometry only, no color
+	rtpool_bind_scene_depth(target);
+	// 1.0 where no geometry lands, the particle shaders test for it
+	glClearDepthf(1.0f);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glDepthFunc(GL_LESS);
+	glUseProgram(depthProgram);
+	scene_draw(&ad->scene);
+
+	// The color pass shades each visible pixel once against the finished depth
+	rtpool_resolve_scene_depth(target);
+	glDepthFunc(GL_EQUAL);
+	glDepthMask(GL_FALSE);
+	glUseProgram(colorProgram);
+	scene_draw(&ad->scene);
+
+	glDepthFunc(GL_LEQUAL);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, target->scene_depth);
+	return EINA_TRUE;
+}
+#endif
+
 /*
  * @brief Drawing function of GLView
  * @param[in] obj GLView object
@@ -239,31 +714,142 @@ static void draw_glview(Evas_Object *obj)
 {
 	appdata_s *ad = evas_object_data_get(obj, "ad");
 
+	// Whatever changes during this frame asks for the next one
+	ad->dirty = 0;
+
+	if (ad->replay.active) {
+		replay_frame(&ad->replay);
+		glview_mark_dirty(ad, DIRTY_REPLAY);
+		return;
+	}
+
+	uint64_t heapAllocs = heap_alloc_count();
+	capture_frame_begin(&ad->capture);
+
+	// Low memory trims and the budget, now that the context is current and before this frame's uses
+	gpumem_apply(&ad->gpumem);
+
+	render_target_s *target = NULL;
+#ifndef GLVIEW_RESIZE_RECREATE
+	target = rtpool_acquire(&ad->targets, ad->glview_w, ad->glview_h);
+	if (target) {
+		rtpool_bind(target);
+	} else {
+		/* No target: draw straight to the surface, at its size */
+		glViewport(0, 0, ad->surface_w, ad->surface_h);
+	}
+#endif
 
 	// Clear the color buffer
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// Use the program object
-	glUseProgram(ad->program);
+#ifdef PARTICLE_DETERMINISTIC
+	/* Hold the last frame once the fixed frame count is reached */
+	float deltaTime = (ad->frame < PARTICLE_DETERMINISTIC_FRAMES) ? PARTICLE_TIME_STEP : 0.0f;
+#else
+	float deltaTime = PARTICLE_TIME_STEP;
+#endif
+	Update(ad, deltaTime);
+	if (deltaTime > 0.0f) {
+		glview_mark_dirty(ad, DIRTY_EMITTERS);
+	}
 
-	Update(ad, 0.02f);
+	GLintptr frameOffset, forceOffset, emitterOffsets[NUM_EMITTERS];
+	Eina_Bool uploaded = UploadParams(ad, deltaTime, target, &frameOffset, &forceOffset, emitterOffsets);
 
-	glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, PARTICLE_SIZE * sizeof(GLfloat), &ad->particleData[0]);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, PARTICLE_SIZE * sizeof(GLfloat), &ad->particleData[1]);
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, PARTICLE_SIZE * sizeof(GLfloat), &ad->particleData[4]);
+	if (uploaded) {
+		ubo_ring_bind(&ad->ubo, FRAME_PARAMS_BINDING, frameOffset, sizeof(frame_params_s));
+		ubo_ring_bind(&ad->ubo, FORCE_PARAMS_BINDING, forceOffset, sizeof(force_params_s));
+		simulation_update(&ad->sim, ad, emitterOffsets, deltaTime);
+		update_readback(ad);
+	}
+
+	variant_features_t mode = 0;
+#ifdef PARTICLE_SOFT
+	if (target && draw_scene(ad, target)) {
+		mode = DRAW_SOFT;
+	}
+#endif
 
+	glBindBuffer(GL_ARRAY_BUFFER, ad->vbo);
+	glVertexAttribPointer(0, 1, GL_FLOAT, GL_FALSE, PARTICLE_SIZE * sizeof(GLfloat), (const void *)0);
 	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glEnableVertexAttribArray(2);
+	glEnableVertexAttribArray(3);
 
 	// Blend particales
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
 
-	glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
+	// One range bind per emitter, the data was uploaded above
+	if (uploaded) {
+		GLuint program = 0;
+		glBindBuffer(GL_ARRAY_BUFFER, simulation_state_buffer(&ad->sim));
+		for (int i = 0; i < NUM_EMITTERS; ++i) {
+			const lod_s *lod = &ad->emitters[i].lod;
+			int count = lod_draw_count(lod);
+			if (count == 0) {
+				continue;
+			}
+			// the program switches only when an emitter's LOD differs from the previous one
+			variant_features_t features = mode | (lod->cheap ? 0 : DRAW_ROUND_POINTS) |
+					(lod_fading(lod) ? DRAW_LOD_FADE : 0);
+			GLuint wanted = variants_get(&ad->shaders, &draw_family, features);
+			if (wanted == 0) {
+				continue;
+			}
+			if (wanted != program) {
+				program = wanted;
+				glUseProgram(program);
+			}
+			GLintptr stateOffset = (GLintptr)i * NUM_PARTICLES * PARTICLE_STATE_SIZE * sizeof(GLfloat);
+			glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, PARTICLE_STATE_SIZE * sizeof(GLfloat), (const void *)stateOffset);
+			ubo_ring_bind(&ad->ubo, EMITTER_PARAMS_BINDING, emitterOffsets[i], sizeof(emitter_params_s));
+			glDrawArrays(GL_POINTS, 0, count);
+		}
+		ubo_ring_fence(&ad->ubo);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	if (mode & DRAW_SOFT) {
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glDepthMask(GL_TRUE);
+		glDisable(GL_DEPTH_TEST);
+	}
 
+#ifdef PARTICLE_GOLDEN_TEST
+	/* Read from the target, before scaling */
+	if (ad->frame + 1 == PARTICLE_DETERMINISTIC_FRAMES) {
+		golden_test(ad);
+	}
+#endif
+	if (target) {
+		rtpool_present(target, ad->surface_w, ad->surface_h);
+	}
 	glFlush();
+
+	capture_frame_end(&ad->capture);
+
+	// Everything allocated for this frame goes at once
+	arena_reset(&ad->frame_arena);
+	if (ad->frame >= ad->first_frame + ARENA_WARMUP_FRAMES) {
+		ad->frame_heap_allocs += heap_alloc_count() - heapAllocs;
+	}
+	if ((ad->frame + 1) % ARENA_REPORT_FRAMES == 0) {
+		report_memory(ad);
+	}
+	if ((ad->frame + 1) % GPUMEM_REPORT_FRAMES == 0) {
+		gpumem_report(&ad->gpumem);
+	}
+	if ((ad->frame + 1) % LOD_REPORT_FRAMES == 0) {
+		report_lod(ad);
+	}
+	if ((ad->frame + 1) % RTPOOL_REPORT_FRAMES == 0) {
+		report_targets(ad);
+	}
+	if ((ad->frame + 1) % VARIANTS_REPORT_FRAMES == 0) {
+		variants_report(&ad->shaders);
+	}
+	ad->frame++;
 }
 
 /*
@@ -274,18 +860,49 @@ static void del_anim(void *data, Evas *evas, Evas_Object *obj, void *event_info)
 {
 	appdata_s *ad = data;
 	ecore_animator_del(ad->ani);
+	ad->ani = NULL;
 }
 
 /*
- * @brief Animator makes GLView to draw new frame
- * param[in] data GLView object
+ * @brief Animator makes GLView to draw new frame when the scene is dirty,
+ *        and freezes itself when it is not
+ * param[in] data appdata
  */
 static Eina_Bool anim(void *data)
 {
-	elm_glview_changed_set(data);
+	appdata_s *ad = data;
+
+	if (ad->dirty) {
+		elm_glview_changed_set(ad->glview);
+	} else {
+		dlog_print(DLOG_INFO, LOG_TAG, "render: scene unchanged after frame %d, animator frozen", ad->frame);
+		ad->ani_frozen = EINA_TRUE;
+		ecore_animator_freeze(ad->ani);
+	}
 	return EINA_TRUE;
 }
 
+void glview_set_paused(appdata_s *ad, Eina_Bool paused)
+{
+	ad->paused = paused;
+	if (paused && ad->ani && !ad->ani_frozen) {
+		ad->ani_frozen = EINA_TRUE;
+		ecore_animator_freeze(ad->ani);
+	} else if (!paused) {
+		/* The surface may have been lost while hidden */
+		glview_mark_dirty(ad, DIRTY_VIEW);
+	}
+}
+
+void glview_mark_dirty(appdata_s *ad, unsigned int flags)
+{
+	ad->dirty |= flags;
+	if (ad->ani_frozen && ad->ani && !ad->paused) {
+		ad->ani_frozen = EINA_FALSE;
+		ecore_animator_thaw(ad->ani);
+	}
+}
+
 void create_glview(appdata_s *ad)
 {
 	Evas_Object *glview = elm_glview_add(ad->conform);
@@ -317,7 +934,16 @@ void create_glview(appdata_s *ad)
 	 * resizes. ELM_GLVIEW_RESIZE_POLICY_RECREATE will tell it to
 	 * destroy the current surface and recreate it to the new size.
 	 */
+#ifdef GLVIEW_RESIZE_RECREATE
 	elm_glview_resize_policy_set(glview, ELM_GLVIEW_RESIZE_POLICY_RECREATE);
+#else
+	/*
+	 * ELM_GLVIEW_RESIZE_POLICY_SCALE keeps the surface and only scales the
+	 * image, so a rotation costs no surface allocation; draw_glview()
+	 * renders at the new size into a pooled target instead.
+	 */
+	elm_glview_resize_policy_set(glview, ELM_GLVIEW_RESIZE_POLICY_SCALE);
+#endif
 
 	/*
 	 * The render policy sets how GLView should render GL code.
@@ -356,6 +982,8 @@ void create_glview(appdata_s *ad)
 	 * NOTE: If you delete GL, this animator will keep running trying to access
 	 * GL so this animator needs to be deleted with ecore_animator_del().
 	 */
-	ad->ani = ecore_animator_add(anim, ad->glview);
+	ad->ani = ecore_animator_add(anim, ad);
+	ad->ani_frozen = EINA_FALSE;
+	ad->dirty = DIRTY_VIEW;
 	evas_object_event_callback_add(ad->glview, EVAS_CALLBACK_DEL, del_anim, ad);
 }
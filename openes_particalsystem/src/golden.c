@@ -0,0 +1,80 @@
+/*
+ * golden.c
+ *
+ * Golden image comparison, see golden.h.
+ */
+
+#include "golden.h"
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void golden_file_name(char *name, int size, int width, int height)
+{
+	snprintf(name, size, "golden_%dx%d.rgba", width, height);
+}
+
+void golden_compare(const char *path, const uint8_t *pixels, int width, int height,
+		int tolerance, float max_bad_ratio, golden_report_s *report)
+{
+	golden_header_s header;
+	FILE *file = fopen(path, "rb");
+
+	report->result = GOLDEN_MISSING;
+	report->bad_pixels = 0;
+	report->max_diff = 0;
+	if (!file) {
+		return;
+	}
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != GOLDEN_MAGIC ||
+			header.width != (uint32_t)width || header.height != (uint32_t)height) {
+		fclose(file);
+		return;
+	}
+
+	/* Compare row by row so the golden image is never fully in memory */
+	uint8_t *row = heap_alloc(width * 4);
+	if (!row) {
+		fclose(file);
+		return;
+	}
+	for (int y = 0; y < height; ++y) {
+		const uint8_t *src = &pixels[(size_t)y * width * 4];
+		if (fread(row, width * 4, 1, file) != 1) {
+			report->bad_pixels = width * height;
+			break;
+		}
+		for (int x = 0; x < width; ++x) {
+			int bad = 0;
+			for (int c = 0; c < 4; ++c) {
+				int diff = abs((int)src[x * 4 + c] - (int)row[x * 4 + c]);
+				if (diff > report->max_diff) {
+					report->max_diff = diff;
+				}
+				if (diff > tolerance) {
+					bad = 1;
+				}
+			}
+			report->bad_pixels += bad;
+		}
+	}
+	heap_free(row);
+	fclose(file);
+
+	report->result = (report->bad_pixels <= max_bad_ratio * width * height) ? GOLDEN_PASS : GOLDEN_FAIL;
+}
+
+int golden_write(const char *path, const uint8_t *pixels, int width, int height)
+{
+	golden_header_s header = { GOLDEN_MAGIC, width, height, 0 };
+	FILE *file = fopen(path, "wb");
+
+	if (!file) {
+		return -1;
+	}
+	int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(pixels, (size_t)width * height * 4, 1, file) == 1;
+	fclose(file);
+	return ok ? 0 : -1;
+}
@@ -0,0 +1,239 @@
+/*
+ * gpumem.c
+ *
+ * GPU memory registry, see gpumem.h.
+ */
+
+#include "gpumem.h"
+
+#include <string.h>
+
+#include "openes_particalsystem.h"
+#include <Elementary_GL_Helpers.h>
+
+ELEMENTARY_GLVIEW_GLOBAL_DECLARE();
+
+#define GPUMEM_REPORT_LARGEST 5
+
+static const char *kind_names[GPUMEM_KIND_COUNT] = {
+	[GPUMEM_BUFFER] = "buffers",
+	[GPUMEM_PROGRAM] = "programs",
+	[GPUMEM_TEXTURE] = "textures",
+	[GPUMEM_RENDERBUFFER] = "renderbuffers",
+};
+
+static gpumem_entry_s *find(gpumem_s *gm, gpumem_kind_e kind, GLuint name)
+{
+	for (int i = 0; i < gm->count; ++i) {
+		if (gm->entries[i].kind == kind && gm->entries[i].name == name) {
+			return &gm->entries[i];
+		}
+	}
+	return NULL;
+}
+
+static void remove_entry(gpumem_s *gm, gpumem_entry_s *entry)
+{
+	gm->total -= entry->bytes;
+	gm->by_kind[entry->kind] -= entry->bytes;
+	*entry = gm->entries[--gm->count];
+}
+
+void gpumem_init(gpumem_s *gm, size_t budget)
+{
+	memset(gm, 0, sizeof(*gm));
+	gm->budget = budget;
+	gm->trim_target = SIZE_MAX;
+}
+
+void gpumem_reserve(gpumem_s *gm, size_t bytes)
+{
+	gm->reserved = bytes;
+}
+
+size_t gpumem_limit(const gpumem_s *gm)
+{
+	return gm->budget + gm->reserved;
+}
+
+Eina_Bool gpumem_track(gpumem_s *gm, gpumem_kind_e kind, GLuint name, size_t bytes, const char *label,
+		gpumem_evict_cb evict, void *evictData)
+{
+	if (name == 0) {
+		return EINA_FALSE;
+	}
+	gpumem_entry_s *entry = find(gm, kind, name);
+	if (entry) {
+		gm->total -= entry->bytes;
+		gm->by_kind[kind] -= entry->bytes;
+	} else if (gm->count < GPUMEM_MAX_ENTRIES) {
+		entry = &gm->entries[gm->count++];
+	} else {
+		dlog_print(DLOG_ERROR, LOG_TAG, "gpumem: registry full, %s (%zu bytes) is not accounted", label, bytes);
+		return EINA_FALSE;
+	}
+
+	entry->kind = kind;
+	entry->name = name;
+	entry->bytes = bytes;
+	entry->label = label;
+	entry->last_use = ++gm->clock;
+	entry->evict = evict;
+	entry->evict_data = evictData;
+
+	gm->total += bytes;
+	gm->by_kind[kind] += bytes;
+	if (gm->total > gm->peak) {
+		gm->peak = gm->total;
+	}
+	return EINA_TRUE;
+}
+
+Eina_Bool gpumem_track_program(gpumem_s *gm, GLuint program, const char *label)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	return gpumem_track(gm, GPUMEM_PROGRAM, program, length > 0 ? length : 0, label, NULL, NULL);
+}
+
+void gpumem_resize(gpumem_s *gm, gpumem_kind_e kind, GLuint name, size_t bytes)
+{
+	gpumem_entry_s *entry = find(gm, kind, name);
+	if (entry) {
+		gpumem_track(gm, kind, name, bytes, entry->label, entry->evict, entry->evict_data);
+	}
+}
+
+void gpumem_touch(gpumem_s *gm, gpumem_kind_e kind, GLuint name)
+{
+	gpumem_entry_s *entry = find(gm, kind, name);
+	if (entry) {
+		entry->last_use = ++gm->clock;
+	}
+}
+
+void gpumem_untrack(gpumem_s *gm, gpumem_kind_e kind, GLuint name)
+{
+	gpumem_entry_s *entry = find(gm, kind, name);
+	if (entry) {
+		remove_entry(gm, entry);
+	}
+}
+
+/*
+ * @brief Evict down to <target>, sparing entries used after <since>
+ */
+static size_t trim(gpumem_s *gm, size_t target, uint64_t since)
+{
+	size_t freed = 0;
+
+	while (gm->total > target) {
+		gpumem_entry_s *oldest = NULL;
+		for (int i = 0; i < gm->count; ++i) {
+			gpumem_entry_s *entry = &gm->entries[i];
+			if (entry->evict && entry->last_use <= since && (!oldest || entry->last_use < oldest->last_use)) {
+				oldest = entry;
+			}
+		}
+		if (!oldest) {
+			break;
+		}
+
+		/* Copy first: the callback may untrack the entry itself */
+		gpumem_entry_s victim = *oldest;
+		remove_entry(gm, oldest);
+		victim.evict(victim.evict_data, victim.name);
+		dlog_print(DLOG_INFO, LOG_TAG, "gpumem: evicted %s %u (%zu bytes)", victim.label, victim.name, victim.bytes);
+
+		freed += victim.bytes;
+		gm->evictions++;
+		gm->evicted_bytes += victim.bytes;
+	}
+	return freed;
+}
+
+/*
+ * @brief Bytes that cannot be evicted this frame: pinned, or used since
+ *        the last gpumem_apply()
+ */
+static size_t in_use(const gpumem_s *gm)
+{
+	size_t bytes = 0;
+	for (int i = 0; i < gm->count; ++i) {
+		const gpumem_entry_s *entry = &gm->entries[i];
+		if (!entry->evict || entry->last_use > gm->frame_clock) {
+			bytes += entry->bytes;
+		}
+	}
+	return bytes;
+}
+
+size_t gpumem_trim(gpumem_s *gm, size_t target)
+{
+	return trim(gm, target, UINT64_MAX);
+}
+
+void gpumem_request_trim(gpumem_s *gm, size_t target)
+{
+	if (target < gm->trim_target) {
+		gm->trim_target = target;
+	}
+}
+
+void gpumem_apply(gpumem_s *gm)
+{
+	if (gm->trim_target != SIZE_MAX) {
+		size_t freed = trim(gm, gm->trim_target, gm->frame_clock);
+		dlog_print(DLOG_INFO, LOG_TAG, "gpumem: trimmed %zu bytes towards %zu", freed, gm->trim_target);
+		gm->trim_target = SIZE_MAX;
+		gpumem_report(gm);
+	} else if (gm->total > gpumem_limit(gm)) {
+		/* Evicting would only hit caches the frame is about to rebuild */
+		size_t used = in_use(gm);
+		if (used > gpumem_limit(gm)) {
+			if (!gm->over_budget) {
+				dlog_print(DLOG_WARN, LOG_TAG, "gpumem: %zu bytes pinned or in use, over the %zu byte limit",
+						used, gpumem_limit(gm));
+			}
+			gm->over_budget = EINA_TRUE;
+		} else {
+			trim(gm, gpumem_limit(gm), gm->frame_clock);
+			gm->over_budget = EINA_FALSE;
+		}
+	} else {
+		gm->over_budget = EINA_FALSE;
+	}
+	gm->frame_clock = gm->clock;
+}
+
+void gpumem_report(const gpumem_s *gm)
+{
+	dlog_print(DLOG_INFO, LOG_TAG, "gpumem: %zu bytes in %d objects (peak %zu, budget %zu + %zu reserved), "
+			"%llu evictions (%zu bytes)", gm->total, gm->count, gm->peak, gm->budget, gm->reserved,
+			(unsigned long long)gm->evictions, gm->evicted_bytes);
+	for (int k = 0; k < GPUMEM_KIND_COUNT; ++k) {
+		if (gm->by_kind[k]) {
+			dlog_print(DLOG_INFO, LOG_TAG, "gpumem:   %-14s %zu bytes", kind_names[k], gm->by_kind[k]);
+		}
+	}
+
+	/* Largest first, by repeated selection: the registry is small */
+	const gpumem_entry_s *shown[GPUMEM_REPORT_LARGEST];
+	int count = 0;
+	for (; count < GPUMEM_REPORT_LARGEST && count < gm->count; ++count) {
+		const gpumem_entry_s *largest = NULL;
+		for (int i = 0; i < gm->count; ++i) {
+			const gpumem_entry_s *entry = &gm->entries[i];
+			Eina_Bool taken = EINA_FALSE;
+			for (int j = 0; j < count; ++j) {
+				taken |= (shown[j] == entry);
+			}
+			if (!taken && (!largest || entry->bytes > largest->bytes)) {
+				largest = entry;
+			}
+		}
+		shown[count] = largest;
+		dlog_print(DLOG_INFO, LOG_TAG, "gpumem:   %-14s %u %zu bytes%s", largest->label, largest->name,
+				largest->bytes, largest->evict ? "" : " (pinned)");
+	}
+}
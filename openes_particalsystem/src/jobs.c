@@ -0,0 +1,217 @@
+/*
+ * jobs.c
+ *
+ * Work-stealing job system, see jobs.h. The deque follows "Correct and
+ * Efficient Work-Stealing for Weak Memory Models" (Le et al., PPoPP 2013).
+ */
+
+#include "jobs.h"
+
+#include <sched.h>
+#include <string.h>
+#include <unistd.h>
+
+#define JOBS_SPIN_ROUNDS 64
+
+static __thread int t_thread;	/* deque of the current thread, 0 for the submitter */
+
+/*
+ * @brief Owner side push
+ * @return 0, -1 if the deque is full
+ */
+static int deque_push(job_deque_s *dq, job_s *job)
+{
+	long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+	long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+	if (b - t >= JOBS_DEQUE_SIZE) {
+		return -1;
+	}
+	atomic_store_explicit(&dq->jobs[b & (JOBS_DEQUE_SIZE - 1)], job, memory_order_relaxed);
+	/* Publishes the job (and what it points to) to thieves loading <bottom> */
+	atomic_store_explicit(&dq->bottom, b + 1, memory_order_release);
+	return 0;
+}
+
+/*
+ * @brief Owner side pop, newest job first
+ */
+static job_s *deque_pop(job_deque_s *dq)
+{
+	long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - 1;
+	atomic_store_explicit(&dq->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long t = atomic_load_explicit(&dq->top, memory_order_relaxed);
+
+	if (t > b) {
+		/* Empty */
+		atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+		return NULL;
+	}
+	job_s *job = atomic_load_explicit(&dq->jobs[b & (JOBS_DEQUE_SIZE - 1)], memory_order_relaxed);
+	if (t == b) {
+		/* Last job: race the thieves for it */
+		if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+				memory_order_seq_cst, memory_order_relaxed)) {
+			job = NULL;
+		}
+		atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+	}
+	return job;
+}
+
+/*
+ * @brief Thief side, oldest job first
+ */
+static job_s *deque_steal(job_deque_s *dq)
+{
+	long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	long b = atomic_load_explicit(&dq->bottom, memory_order_acquire);
+
+	if (t >= b) {
+		return NULL;
+	}
+	job_s *job = atomic_load_explicit(&dq->jobs[t & (JOBS_DEQUE_SIZE - 1)], memory_order_relaxed);
+	if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+			memory_order_seq_cst, memory_order_relaxed)) {
+		return NULL;
+	}
+	return job;
+}
+
+static void run(job_system_s *js, job_s *job, int thread)
+{
+	job->func(job->data, thread);
+	atomic_fetch_add_explicit(&js->executed[thread], 1, memory_order_relaxed);
+	atomic_fetch_sub_explicit(&job->counter->pending, 1, memory_order_release);
+}
+
+/*
+ * @brief Take a job: own deque first, then the others starting after our own
+ */
+static job_s *take(job_system_s *js, int thread)
+{
+	job_s *job = deque_pop(&js->deques[thread]);
+	for (int i = 1; !job && i < js->thread_count; ++i) {
+		job = deque_steal(&js->deques[(thread + i) % js->thread_count]);
+		if (job) {
+			atomic_fetch_add_explicit(&js->stolen, 1, memory_order_relaxed);
+		}
+	}
+	if (job) {
+		atomic_fetch_sub_explicit(&js->queued, 1, memory_order_relaxed);
+	}
+	return job;
+}
+
+static void *worker(void *data)
+{
+	job_worker_s *self = data;
+	job_system_s *js = self->js;
+	t_thread = self->index;
+
+	while (atomic_load(&js->running)) {
+		job_s *job = NULL;
+		for (int spin = 0; !job && spin < JOBS_SPIN_ROUNDS; ++spin) {
+			job = take(js, t_thread);
+		}
+		if (job) {
+			run(js, job, t_thread);
+			continue;
+		}
+
+		/* Nothing to steal: sleep until jobs_submit() or jobs_shutdown() */
+		pthread_mutex_lock(&js->lock);
+		atomic_fetch_add(&js->sleepers, 1);
+		while (atomic_load(&js->running) && atomic_load(&js->queued) == 0) {
+			pthread_cond_wait(&js->wake, &js->lock);
+		}
+		atomic_fetch_sub(&js->sleepers, 1);
+		pthread_mutex_unlock(&js->lock);
+	}
+	return NULL;
+}
+
+/*
+ * @brief Wake and join workers 1 .. <started>-1
+ */
+static void stop(job_system_s *js, int started)
+{
+	pthread_mutex_lock(&js->lock);
+	atomic_store(&js->running, 0);
+	pthread_cond_broadcast(&js->wake);
+	pthread_mutex_unlock(&js->lock);
+
+	for (int i = 1; i < started; ++i) {
+		pthread_join(js->threads[i], NULL);
+	}
+}
+
+int jobs_init(job_system_s *js, int threads)
+{
+	memset(js, 0, sizeof(*js));
+	if (threads <= 0) {
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cores > 0 ? (int)cores : 1;
+	}
+	if (threads > JOBS_MAX_THREADS) {
+		threads = JOBS_MAX_THREADS;
+	}
+
+	pthread_mutex_init(&js->lock, NULL);
+	pthread_cond_init(&js->wake, NULL);
+	atomic_store(&js->running, 1);
+	t_thread = 0;
+
+	/* Workers scan every deque from the start, so the count is final first */
+	js->thread_count = threads;
+	for (int i = 1; i < threads; ++i) {
+		js->workers[i].js = js;
+		js->workers[i].index = i;
+		if (pthread_create(&js->threads[i], NULL, worker, &js->workers[i]) != 0) {
+			/* Run everything on the calling thread rather than on a partial pool */
+			stop(js, i);
+			js->thread_count = 1;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void jobs_submit(job_system_s *js, job_s *job, job_counter_s *counter)
+{
+	job->counter = counter;
+	atomic_fetch_add_explicit(&counter->pending, 1, memory_order_relaxed);
+
+	if (js->thread_count == 1 || deque_push(&js->deques[t_thread], job) != 0) {
+		run(js, job, t_thread);
+		return;
+	}
+	atomic_fetch_add(&js->queued, 1);
+	if (atomic_load(&js->sleepers) > 0) {
+		pthread_mutex_lock(&js->lock);
+		pthread_cond_signal(&js->wake);
+		pthread_mutex_unlock(&js->lock);
+	}
+}
+
+void jobs_wait(job_system_s *js, job_counter_s *counter)
+{
+	while (atomic_load_explicit(&counter->pending, memory_order_acquire) > 0) {
+		job_s *job = take(js, t_thread);
+		if (job) {
+			run(js, job, t_thread);
+		} else {
+			/* The last jobs are running elsewhere */
+			sched_yield();
+		}
+	}
+}
+
+void jobs_shutdown(job_system_s *js)
+{
+	stop(js, js->thread_count);
+	pthread_mutex_destroy(&js->lock);
+	pthread_cond_destroy(&js->wake);
+	js->thread_count = 1;
+}
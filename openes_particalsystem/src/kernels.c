@@ -0,0 +1,172 @@
+/*
+ * kernels.c
+ *
+ * CPU kernels over whole particle arrays, see kernels.h.
+ */
+
+#include "kernels.h"
+
+#include <string.h>
+
+#include "particles.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#define SNORM16_MAX 32767.0f
+/* Adding and subtracting 1.5 * 2^23 rounds to nearest even below 2^22, as long as it is not folded by -ffast-math */
+#define ROUND_MAGIC 12582912.0f
+
+void kernel_rng_seed(kernel_rng_s *rng, uint32_t seed)
+{
+	for (int lane = 0; lane < KERNEL_RNG_LANES; ++lane) {
+		particle_rng_s stream;
+		particle_rng_seed(&stream, seed + lane * 0x9e3779b9u);
+		rng->state[lane] = stream.state;
+	}
+}
+
+void kernel_rng_fill_scalar(kernel_rng_s *rng, float *out, int count)
+{
+	for (int i = 0; i < count; i += KERNEL_RNG_LANES) {
+		for (int lane = 0; lane < KERNEL_RNG_LANES; ++lane) {
+			uint32_t x = rng->state[lane];
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			rng->state[lane] = x;
+			/* 24 bits fit exactly in a float mantissa */
+			out[i + lane] = (x >> 8) * (1.0f / 16777216.0f);
+		}
+	}
+}
+
+void kernel_rng_fill_simd(kernel_rng_s *rng, float *out, int count)
+{
+#if defined(__SSE2__)
+	__m128i x = _mm_loadu_si128((const __m128i *)rng->state);
+	const __m128 scale = _mm_set1_ps(1.0f / 16777216.0f);
+	for (int i = 0; i < count; i += KERNEL_RNG_LANES) {
+		x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+		x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+		x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+		_mm_storeu_ps(&out[i], _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(x, 8)), scale));
+	}
+	_mm_storeu_si128((__m128i *)rng->state, x);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	uint32x4_t x = vld1q_u32(rng->state);
+	for (int i = 0; i < count; i += KERNEL_RNG_LANES) {
+		x = veorq_u32(x, vshlq_n_u32(x, 13));
+		x = veorq_u32(x, vshrq_n_u32(x, 17));
+		x = veorq_u32(x, vshlq_n_u32(x, 5));
+		vst1q_f32(&out[i], vmulq_n_f32(vcvtq_f32_u32(vshrq_n_u32(x, 8)), 1.0f / 16777216.0f));
+	}
+	vst1q_u32(rng->state, x);
+#else
+	kernel_rng_fill_scalar(rng, out, count);
+#endif
+}
+
+void kernel_pack_positions_scalar(const float *state, int16_t *packed, int count)
+{
+	for (int i = 0; i < count; ++i) {
+		const float *pos = &state[i * PARTICLE_STATE_SIZE];
+		int16_t *out = &packed[i * 4];
+		for (int k = 0; k < 3; ++k) {
+			float v = pos[k] * SNORM16_MAX;
+			v = v < -SNORM16_MAX ? -SNORM16_MAX : (v > SNORM16_MAX ? SNORM16_MAX : v);
+			out[k] = (int16_t)((v + ROUND_MAGIC) - ROUND_MAGIC);
+		}
+		out[3] = 0;
+	}
+}
+
+void kernel_pack_positions_simd(const float *state, int16_t *packed, int count)
+{
+	/*
+	 * Four floats are loaded per particle: the position and the first
+	 * velocity component, which is scaled to 0. The last particle's load
+	 * stays inside its own state.
+	 */
+#if defined(__SSE2__)
+	const __m128 scale = _mm_setr_ps(SNORM16_MAX, SNORM16_MAX, SNORM16_MAX, 0.0f);
+	const __m128 lo = _mm_set1_ps(-SNORM16_MAX), hi = _mm_set1_ps(SNORM16_MAX);
+	for (int i = 0; i < count; ++i) {
+		__m128 v = _mm_mul_ps(_mm_loadu_ps(&state[i * PARTICLE_STATE_SIZE]), scale);
+		__m128i q = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, lo), hi));
+		_mm_storel_epi64((__m128i *)&packed[i * 4], _mm_packs_epi32(q, q));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	const float scaleValues[4] = { SNORM16_MAX, SNORM16_MAX, SNORM16_MAX, 0.0f };
+	const float32x4_t scale = vld1q_f32(scaleValues);
+	const float32x4_t lo = vdupq_n_f32(-SNORM16_MAX), hi = vdupq_n_f32(SNORM16_MAX);
+	for (int i = 0; i < count; ++i) {
+		float32x4_t v = vmulq_f32(vld1q_f32(&state[i * PARTICLE_STATE_SIZE]), scale);
+		v = vminq_f32(vmaxq_f32(v, lo), hi);
+#if defined(__aarch64__)
+		int32x4_t q = vcvtnq_s32_f32(v);
+#else
+		/* No round to nearest conversion on ARMv7: add half away from zero, truncate */
+		uint32x4_t negative = vcltq_f32(v, vdupq_n_f32(0.0f));
+		float32x4_t half = vbslq_f32(negative, vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+		int32x4_t q = vcvtq_s32_f32(vaddq_f32(v, half));
+#endif
+		vst1_s16(&packed[i * 4], vqmovn_s32(q));
+	}
+#else
+	kernel_pack_positions_scalar(state, packed, count);
+#endif
+}
+
+/*
+ * @brief Key of a depth that sorts unsigned ascending from the largest z
+ *        to the smallest
+ */
+static uint32_t depth_key(float z)
+{
+	uint32_t bits;
+	memcpy(&bits, &z, sizeof(bits));
+	/* Map floats to unsigned order, then reverse it */
+	bits ^= (bits & 0x80000000u) ? 0xffffffffu : 0x80000000u;
+	return ~bits;
+}
+
+void kernel_sort_depth(const float *state, uint32_t *order, uint32_t *scratch, int count)
+{
+	uint32_t *keys = scratch;
+	uint32_t *keysOut = scratch + count;
+	uint32_t *orderOut = scratch + 2 * (size_t)count;
+
+	for (int i = 0; i < count; ++i) {
+		keys[i] = depth_key(state[i * PARTICLE_STATE_SIZE + 2]);
+		order[i] = i;
+	}
+
+	/* Four passes of 8 bits; an even count leaves the result in <order> */
+	for (int shift = 0; shift < 32; shift += 8) {
+		uint32_t offsets[256] = { 0 };
+		for (int i = 0; i < count; ++i) {
+			offsets[(keys[i] >> shift) & 0xff]++;
+		}
+		uint32_t sum = 0;
+		for (int b = 0; b < 256; ++b) {
+			uint32_t n = offsets[b];
+			offsets[b] = sum;
+			sum += n;
+		}
+		for (int i = 0; i < count; ++i) {
+			uint32_t slot = offsets[(keys[i] >> shift) & 0xff]++;
+			keysOut[slot] = keys[i];
+			orderOut[slot] = order[i];
+		}
+		uint32_t *swap = keys;
+		keys = keysOut;
+		keysOut = swap;
+		swap = order;
+		order = orderOut;
+		orderOut = swap;
+	}
+}
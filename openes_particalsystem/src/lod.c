@@ -0,0 +1,92 @@
+/*
+ * lod.c
+ *
+ * Particle level of detail, see lod.h.
+ */
+
+#include "lod.h"
+
+#include <math.h>
+
+#include "particles.h"
+
+void lod_init(lod_s *lod, const float *data, int capacity)
+{
+	/* Farthest a particle gets from the center within a one second burst */
+	float radius = 0.0f;
+	for (int i = 0; i < capacity; ++i) {
+		const float *particle = &data[i * PARTICLE_SIZE];
+		for (int axis = 0; axis < 3; ++axis) {
+			float reach = fabsf(particle[1 + axis]) + fabsf(particle[4 + axis]) * particle[0];
+			radius = fmaxf(radius, reach);
+		}
+	}
+
+	lod->radius = radius;
+	lod->capacity = capacity;
+	lod->coverage = 0.0f;
+	lod->target = lod->count = -1.0f;
+	lod->point_scale = 1.0f;
+	lod->cheap = 0;
+}
+
+/*
+ * @brief Length of [center - radius, center + radius] inside [-1, 1]
+ */
+static float visible_extent(float center, float radius)
+{
+	float extent = fminf(center + radius, 1.0f) - fmaxf(center - radius, -1.0f);
+	return fmaxf(extent, 0.0f);
+}
+
+void lod_update(lod_s *lod, const float center[3], float width, float height, float dt)
+{
+	/* The footprint is a square in NDC; the viewport maps 2 NDC units to <width> pixels */
+	float w = visible_extent(center[0], lod->radius) * 0.5f * width;
+	float h = visible_extent(center[1], lod->radius) * 0.5f * height;
+	float depth = visible_extent(center[2], lod->radius);
+	lod->coverage = depth > 0.0f ? w * h : 0.0f;
+
+	/* Scaled so that a full emitter has no particle in the fade band */
+	float full = lod->capacity + LOD_FADE_PARTICLES;
+	lod->target = fminf(lod->coverage / (LOD_PIXELS_PER_PARTICLE * lod->capacity), 1.0f) * full;
+	if (lod->count < 0.0f || dt <= 0.0f) {
+		lod->count = lod->target;
+	} else {
+		float step = LOD_RATE * full * dt;
+		lod->count += fmaxf(fminf(lod->target - lod->count, step), -step);
+	}
+
+	/* Same for every emitter, see lod.h */
+	lod->point_scale = fminf(width, height) / LOD_REFERENCE_SIZE;
+	float pointSize = LOD_POINT_SIZE * lod->point_scale;
+	if (lod->cheap) {
+		lod->cheap = pointSize < LOD_CHEAP_POINT_SIZE + LOD_CHEAP_HYSTERESIS;
+	} else {
+		lod->cheap = pointSize < LOD_CHEAP_POINT_SIZE;
+	}
+}
+
+int lod_draw_count(const lod_s *lod)
+{
+	float count = ceilf(lod->count);
+	if (count <= 0.0f) {
+		return 0;
+	}
+	return count < lod->capacity ? (int)count : lod->capacity;
+}
+
+int lod_fading(const lod_s *lod)
+{
+	return lod->count - LOD_FADE_PARTICLES < lod->capacity;
+}
+
+void lod_uniform(const lod_s *lod, lod_uniform_t uniform)
+{
+	uniform[0] = lod->count;
+	uniform[1] = LOD_FADE_PARTICLES;
+	uniform[2] = lod->point_scale;
+	/* Particles in the fade band count half */
+	float drawn = fminf(lod->count - 0.5f * LOD_FADE_PARTICLES, (float)lod->capacity);
+	uniform[3] = drawn > 0.0f ? fminf(lod->capacity / drawn, LOD_MAX_ALPHA_SCALE) : LOD_MAX_ALPHA_SCALE;
+}
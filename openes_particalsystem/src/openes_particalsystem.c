@@ -71,18 +71,25 @@ static void
 app_pause(void *data)
 {
 	/* Take necessary actions when application becomes invisible. */
+	glview_set_paused(data, EINA_TRUE);
+	/* We may be killed from here on: keep the particle state */
+	glview_save_snapshot(data);
 }
 
 static void
 app_resume(void *data)
 {
 	/* Take necessary actions when application becomes visible. */
+	glview_set_paused(data, EINA_FALSE);
 }
 
 static void
 app_terminate(void *data)
 {
 	/* Release all resources. */
+	appdata_s *ad = data;
+	/* Let a snapshot started on pause reach the disk */
+	snapshot_writer_join(&ad->snapshot);
 }
 
 static void
@@ -109,7 +116,19 @@ static void
 ui_app_orient_changed(app_event_info_h event_info, void *user_data)
 {
 	/*APP_EVENT_DEVICE_ORIENTATION_CHANGED*/
-	return;
+	appdata_s *ad = user_data;
+	app_device_orientation_e orientation;
+
+	if (app_event_get_device_orientation(event_info, &orientation) == APP_ERROR_NONE) {
+		dlog_print(DLOG_INFO, LOG_TAG, "orientation %d", orientation);
+	}
+
+	/*
+	 * No GL work here: the context is not current. The resize that follows
+	 * finds its target prewarmed in the pool (see rtpool.h); just make sure
+	 * the animator is running to draw it.
+	 */
+	glview_mark_dirty(ad, DIRTY_VIEW);
 }
 
 static void
@@ -128,6 +147,21 @@ static void
 ui_app_low_memory(app_event_info_h event_info, void *user_data)
 {
 	/*APP_EVENT_LOW_MEMORY*/
+	appdata_s *ad = user_data;
+	app_event_low_memory_status_e status;
+
+	if (app_event_get_low_memory_status(event_info, &status) != APP_ERROR_NONE) {
+		return;
+	}
+	dlog_print(DLOG_WARN, LOG_TAG, "low memory (status %d), %zu bytes of GL objects", status, ad->gpumem.total);
+
+	/* The context is not current here: the next frame evicts */
+	if (status == APP_EVENT_LOW_MEMORY_HARD_WARNING) {
+		gpumem_request_trim(&ad->gpumem, 0);
+	} else if (status == APP_EVENT_LOW_MEMORY_SOFT_WARNING) {
+		gpumem_request_trim(&ad->gpumem, ad->gpumem.reserved + ad->gpumem.budget / 2);
+	}
+	glview_mark_dirty(ad, DIRTY_GPUMEM);
 }
 
 int
@@ -0,0 +1,250 @@
+/*
+ * particles.c
+ *
+ * CPU side particle kernels, see particles.h.
+ */
+
+#include "particles.h"
+
+#include <math.h>
+#include <time.h>
+
+void particle_rng_seed(particle_rng_s *rng, uint32_t seed)
+{
+	/* Scramble the seed, xorshift must never start from 0 */
+	seed = (seed ^ 61u) ^ (seed >> 16);
+	seed *= 9u;
+	seed ^= seed >> 4;
+	seed *= 0x27d4eb2du;
+	seed ^= seed >> 15;
+	rng->state = seed ? seed : 0x9e3779b9u;
+}
+
+uint32_t particle_rng_next(particle_rng_s *rng)
+{
+	uint32_t x = rng->state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	rng->state = x;
+	return x;
+}
+
+float particle_rng_float(particle_rng_s *rng)
+{
+	/* 24 bits fit exactly in a float mantissa */
+	return (particle_rng_next(rng) >> 8) * (1.0f / 16777216.0f);
+}
+
+void particles_init(float *data, int count, particle_rng_s *rng)
+{
+	for (int i = 0; i < count; ++i) {
+		float *particleData = &data[i * PARTICLE_SIZE];
+		// lifetime of particle
+		(*particleData++) = particle_rng_float(rng);
+		// a_startPosition: offset from the emitter center
+		(*particleData++) = particle_rng_float(rng) * 2.0f - 1.0f;
+		(*particleData++) = particle_rng_float(rng) * 2.0f - 1.0f;
+		(*particleData++) = particle_rng_float(rng) * 2.0f - 1.0f;
+		// a_endPosition: distance travelled per second
+		(*particleData++) = particle_rng_float(rng) * 0.25f - 0.125f;
+		(*particleData++) = particle_rng_float(rng) * 0.25f - 0.125f;
+		(*particleData++) = particle_rng_float(rng) * 0.25f - 0.125f;
+	}
+}
+
+void particles_pick_burst(particle_rng_s *rng, float center[3], float color[4])
+{
+	// Pick a new start location and color
+	center[0] = particle_rng_float(rng) - 0.5f;
+	center[1] = particle_rng_float(rng) - 0.5f;
+	center[2] = particle_rng_float(rng) - 0.5f;
+
+	// random color
+	color[0] = particle_rng_float(rng) * 0.5f + 0.5f;
+	color[1] = particle_rng_float(rng) * 0.5f + 0.5f;
+	color[2] = particle_rng_float(rng) * 0.5f + 0.5f;
+	color[3] = 0.5f;
+}
+
+void particles_reset_state(const float *data, float *state, int count, const float center[3])
+{
+	for (int i = 0; i < count; ++i) {
+		const float *particle = &data[i * PARTICLE_SIZE];
+		float *s = &state[i * PARTICLE_STATE_SIZE];
+		s[0] = particle[1] + center[0];
+		s[1] = particle[2] + center[1];
+		s[2] = particle[3] + center[2];
+		s[3] = particle[4];
+		s[4] = particle[5];
+		s[5] = particle[6];
+	}
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+/*
+ * Curl of the potential field
+ *   A = (sin(fy+a)cos(fz+b), sin(fz+a)cos(fx+b), sin(fx+a)cos(fy+b))
+ * which is divergence free, so particles swirl without bunching up.
+ */
+static void curl_noise(const float *p, float f, float phase, float out[3])
+{
+	float a = phase, b = phase * 1.3f;
+	float sx = sinf(f * p[0] + a), cx = cosf(f * p[0] + a), sxb = sinf(f * p[0] + b), cxb = cosf(f * p[0] + b);
+	float sy = sinf(f * p[1] + a), cy = cosf(f * p[1] + a), syb = sinf(f * p[1] + b), cyb = cosf(f * p[1] + b);
+	float sz = sinf(f * p[2] + a), cz = cosf(f * p[2] + a), szb = sinf(f * p[2] + b), czb = cosf(f * p[2] + b);
+
+	out[0] = f * (-sx * syb - cz * cxb);
+	out[1] = f * (-sy * szb - cx * cyb);
+	out[2] = f * (-sz * sxb - cy * czb);
+}
+
+static void apply_force(const particle_force_s *force, const float *state, float *accel, int count, float time)
+{
+	int type = (int)force->params[0];
+	float strength = force->params[1];
+	const float *v = force->vector;
+
+	for (int i = 0; i < count; ++i) {
+		const float *pos = &state[i * PARTICLE_STATE_SIZE];
+		const float *vel = pos + 3;
+		float *a = &accel[i * 3];
+
+		switch (type) {
+		case PARTICLE_FORCE_GRAVITY:
+			a[0] += v[0] * strength;
+			a[1] += v[1] * strength;
+			a[2] += v[2] * strength;
+			break;
+		case PARTICLE_FORCE_DRAG:
+			a[0] -= vel[0] * strength;
+			a[1] -= vel[1] * strength;
+			a[2] -= vel[2] * strength;
+			break;
+		case PARTICLE_FORCE_ATTRACTOR: {
+			float d[3] = { v[0] - pos[0], v[1] - pos[1], v[2] - pos[2] };
+			float r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2] + force->params[2] * force->params[2];
+			float k = strength / (r2 * sqrtf(r2));
+			a[0] += d[0] * k;
+			a[1] += d[1] * k;
+			a[2] += d[2] * k;
+			break;
+		}
+		case PARTICLE_FORCE_TURBULENCE: {
+			float c[3];
+			curl_noise(pos, force->params[2], time * force->params[3], c);
+			a[0] += c[0] * strength;
+			a[1] += c[1] * strength;
+			a[2] += c[2] * strength;
+			break;
+		}
+		default:
+			break;
+		}
+	}
+}
+
+/*
+ * @brief Push a particle out of a collider and reflect its velocity
+ * @param[in] n unit contact normal
+ * @param[in] depth penetration depth, > 0 when inside
+ */
+static void resolve_contact(float *pos, float *vel, const float n[3], float depth, float restitution, float friction)
+{
+	pos[0] += n[0] * depth;
+	pos[1] += n[1] * depth;
+	pos[2] += n[2] * depth;
+
+	float vn = vel[0] * n[0] + vel[1] * n[1] + vel[2] * n[2];
+	if (vn < 0.0f) {
+		/* Split into normal and tangential parts: bounce one, damp the other */
+		float t[3] = { vel[0] - vn * n[0], vel[1] - vn * n[1], vel[2] - vn * n[2] };
+		for (int k = 0; k < 3; ++k) {
+			vel[k] = t[k] * (1.0f - friction) - n[k] * vn * restitution;
+		}
+	}
+}
+
+static void apply_collider(const particle_force_s *collider, float *state, int count)
+{
+	int type = (int)collider->params[0];
+	const float *v = collider->vector;
+	float restitution = collider->params[2];
+	float friction = collider->params[3];
+
+	for (int i = 0; i < count; ++i) {
+		float *pos = &state[i * PARTICLE_STATE_SIZE];
+		float *vel = pos + 3;
+
+		if (type == PARTICLE_COLLIDER_PLANE) {
+			float depth = v[3] - (pos[0] * v[0] + pos[1] * v[1] + pos[2] * v[2]);
+			if (depth > 0.0f) {
+				resolve_contact(pos, vel, v, depth, restitution, friction);
+			}
+		} else if (type == PARTICLE_COLLIDER_SPHERE) {
+			float d[3] = { pos[0] - v[0], pos[1] - v[1], pos[2] - v[2] };
+			float dist = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+			if (dist < v[3] && dist > 0.0f) {
+				float n[3] = { d[0] / dist, d[1] / dist, d[2] / dist };
+				resolve_contact(pos, vel, n, v[3] - dist, restitution, friction);
+			}
+		}
+	}
+}
+
+void particles_simulate(float *state, int count, const particle_force_s *forces, int forceCount,
+		float dt, float time, float *accel, particle_force_stats_s *stats)
+{
+	/* Force-major loops, so every force can be timed on its own */
+	for (int i = 0; i < count * 3; ++i) {
+		accel[i] = 0.0f;
+	}
+	for (int f = 0; f < forceCount; ++f) {
+		if ((int)forces[f].params[0] >= PARTICLE_COLLIDER_PLANE) {
+			continue;
+		}
+		uint64_t start = stats ? now_ns() : 0;
+		apply_force(&forces[f], state, accel, count, time);
+		if (stats) {
+			stats[f].ns += now_ns() - start;
+			stats[f].evaluations += count;
+		}
+	}
+
+	// semi-implicit Euler: without forces this is exactly start + t * end
+	for (int i = 0; i < count; ++i) {
+		float *pos = &state[i * PARTICLE_STATE_SIZE];
+		float *vel = pos + 3;
+		const float *a = &accel[i * 3];
+		for (int k = 0; k < 3; ++k) {
+			vel[k] += a[k] * dt;
+			pos[k] += vel[k] * dt;
+		}
+	}
+
+	for (int f = 0; f < forceCount; ++f) {
+		if ((int)forces[f].params[0] < PARTICLE_COLLIDER_PLANE) {
+			continue;
+		}
+		uint64_t start = stats ? now_ns() : 0;
+		apply_collider(&forces[f], state, count);
+		if (stats) {
+			stats[f].ns += now_ns() - start;
+			stats[f].evaluations += count;
+		}
+	}
+}
+
+const char *particle_force_name(int type)
+{
+	static const char *names[PARTICLE_FORCE_TYPE_COUNT] = {
+		"gravity", "drag", "attractor", "turbulence", "plane", "sphere"
+	};
+	return (type >= 0 && type < PARTICLE_FORCE_TYPE_COUNT) ? names[type] : "unknown";
+}
@@ -0,0 +1,436 @@
+/*
+ * replay.c
+ *
+ * Replay side of the GL command capture, see capture.h.
+ *
+ * Object names and uniform locations returned by the driver differ from the
+ * recorded ones, so the replay keeps translation tables for them. Client
+ * vertex and index data are passed to GL straight out of the file mapping.
+ */
+
+#include "capture.h"
+
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dlog.h>
+
+#include "openes_particalsystem.h"
+#include <Elementary_GL_Helpers.h>
+
+ELEMENTARY_GLVIEW_GLOBAL_DECLARE();
+
+static float u2f(uint32_t u)
+{
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static GLuint map_name(GLuint *table, uint32_t name)
+{
+	return name < CAPTURE_MAX_NAMES ? table[name] : 0;
+}
+
+static void set_name(GLuint *table, uint32_t from, GLuint to)
+{
+	if (from < CAPTURE_MAX_NAMES) {
+		table[from] = to;
+	} else {
+		dlog_print(DLOG_WARN, LOG_TAG, "replay: object name %u out of range", from);
+	}
+}
+
+static GLint map_uniform(replay_s *rp, GLint location)
+{
+	for (int i = 0; i < rp->uniform_count; ++i) {
+		if (rp->uniforms[i].program == rp->program && rp->uniforms[i].from == location) {
+			return rp->uniforms[i].to;
+		}
+	}
+	return -1;
+}
+
+/*
+ * @brief Execute the record at the cursor and advance past it
+ * @return the op of the executed record
+ */
+static capture_op_e execute_record(replay_s *rp)
+{
+	const capture_record_header_s *header = (const capture_record_header_s *)(rp->map + rp->cursor);
+	const uint32_t *w = (const uint32_t *)(header + 1);
+	const void *data = w + header->words;
+	capture_op_e op = header->op;
+
+	rp->cursor += sizeof(*header) + header->words * sizeof(uint32_t) + ((header->size + 3) & ~3u);
+	if (op > 0 && op < CAPTURE_OP_COUNT) {
+		rp->counts[op]++;
+	}
+
+	switch (op) {
+	case CAPTURE_OP_CREATE_SHADER:
+		set_name(rp->names, w[1], glCreateShader(w[0]));
+		break;
+	case CAPTURE_OP_SHADER_SOURCE: {
+		const char *source = data;
+		glShaderSource(map_name(rp->names, w[0]), 1, &source, NULL);
+		break;
+	}
+	case CAPTURE_OP_COMPILE_SHADER:
+		glCompileShader(map_name(rp->names, w[0]));
+		break;
+	case CAPTURE_OP_DELETE_SHADER:
+		glDeleteShader(map_name(rp->names, w[0]));
+		break;
+	case CAPTURE_OP_CREATE_PROGRAM:
+		set_name(rp->names, w[0], glCreateProgram());
+		break;
+	case CAPTURE_OP_ATTACH_SHADER:
+		glAttachShader(map_name(rp->names, w[0]), map_name(rp->names, w[1]));
+		break;
+	case CAPTURE_OP_LINK_PROGRAM:
+		glLinkProgram(map_name(rp->names, w[0]));
+		break;
+	case CAPTURE_OP_DELETE_PROGRAM:
+		glDeleteProgram(map_name(rp->names, w[0]));
+		break;
+	case CAPTURE_OP_GET_UNIFORM_LOCATION:
+		if (rp->uniform_count < CAPTURE_MAX_UNIFORMS) {
+			replay_uniform_s *uniform = &rp->uniforms[rp->uniform_count++];
+			uniform->program = w[0];
+			uniform->from = (GLint)w[1];
+			uniform->to = glGetUniformLocation(map_name(rp->names, w[0]), data);
+		}
+		break;
+	case CAPTURE_OP_USE_PROGRAM:
+		rp->program = w[0];
+		glUseProgram(map_name(rp->names, w[0]));
+		break;
+	case CAPTURE_OP_UNIFORM1F:
+		glUniform1f(map_uniform(rp, w[0]), u2f(w[1]));
+		break;
+	case CAPTURE_OP_UNIFORM1I:
+		glUniform1i(map_uniform(rp, w[0]), (GLint)w[1]);
+		break;
+	case CAPTURE_OP_UNIFORM3FV:
+		glUniform3fv(map_uniform(rp, w[0]), w[1], data);
+		break;
+	case CAPTURE_OP_UNIFORM4FV:
+		glUniform4fv(map_uniform(rp, w[0]), w[1], data);
+		break;
+	case CAPTURE_OP_CLEAR_COLOR:
+		glClearColor(u2f(w[0]), u2f(w[1]), u2f(w[2]), u2f(w[3]));
+		break;
+	case CAPTURE_OP_CLEAR:
+		glClear(w[0]);
+		break;
+	case CAPTURE_OP_VIEWPORT:
+		glViewport(w[0], w[1], w[2], w[3]);
+		break;
+	case CAPTURE_OP_ENABLE:
+		glEnable(w[0]);
+		break;
+	case CAPTURE_OP_DISABLE:
+		glDisable(w[0]);
+		break;
+	case CAPTURE_OP_BLEND_FUNC:
+		glBlendFunc(w[0], w[1]);
+		break;
+	case CAPTURE_OP_DEPTH_FUNC:
+		glDepthFunc(w[0]);
+		break;
+	case CAPTURE_OP_DEPTH_MASK:
+		glDepthMask(w[0]);
+		break;
+	case CAPTURE_OP_ENABLE_VERTEX_ATTRIB_ARRAY:
+		glEnableVertexAttribArray(w[0]);
+		break;
+	case CAPTURE_OP_DISABLE_VERTEX_ATTRIB_ARRAY:
+		glDisableVertexAttribArray(w[0]);
+		break;
+	case CAPTURE_OP_VERTEX_ATTRIB_POINTER:
+		glVertexAttribPointer(w[0], w[1], w[2], w[3], w[4], (const void *)(uintptr_t)w[5]);
+		break;
+	case CAPTURE_OP_CLIENT_ATTRIB: {
+		/* The recorded range starts at vertex <first>, rebase the pointer to vertex 0 */
+		GLint array_buffer = 0;
+		glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &array_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glVertexAttribPointer(w[0], w[1], w[2], w[3], w[4], (const unsigned char *)data - (size_t)w[5] * w[4]);
+		glBindBuffer(GL_ARRAY_BUFFER, array_buffer);
+		break;
+	}
+	case CAPTURE_OP_GEN_BUFFERS: {
+		const GLuint *names = data;
+		for (uint32_t i = 0; i < w[0]; ++i) {
+			GLuint buffer;
+			glGenBuffers(1, &buffer);
+			set_name(rp->buffers, names[i], buffer);
+		}
+		break;
+	}
+	case CAPTURE_OP_DELETE_BUFFERS: {
+		const GLuint *names = data;
+		for (uint32_t i = 0; i < w[0]; ++i) {
+			GLuint buffer = map_name(rp->buffers, names[i]);
+			glDeleteBuffers(1, &buffer);
+			set_name(rp->buffers, names[i], 0);
+		}
+		break;
+	}
+	case CAPTURE_OP_BIND_BUFFER:
+		glBindBuffer(w[0], map_name(rp->buffers, w[1]));
+		break;
+	case CAPTURE_OP_BUFFER_DATA:
+		glBufferData(w[0], w[1], w[3] ? data : NULL, w[2]);
+		break;
+	case CAPTURE_OP_BUFFER_SUB_DATA:
+		glBufferSubData(w[0], w[1], w[2], data);
+		break;
+	case CAPTURE_OP_COPY_BUFFER_SUB_DATA:
+		glCopyBufferSubData(w[0], w[1], w[2], w[3], w[4]);
+		break;
+	case CAPTURE_OP_GET_UNIFORM_BLOCK_INDEX:
+		if (rp->block_count < CAPTURE_MAX_UNIFORMS) {
+			replay_uniform_s *block = &rp->blocks[rp->block_count++];
+			block->program = w[0];
+			block->from = (GLint)w[1];
+			block->to = glGetUniformBlockIndex(map_name(rp->names, w[0]), data);
+		}
+		break;
+	case CAPTURE_OP_UNIFORM_BLOCK_BINDING: {
+		GLuint index = GL_INVALID_INDEX;
+		for (int i = 0; i < rp->block_count; ++i) {
+			if (rp->blocks[i].program == w[0] && rp->blocks[i].from == (GLint)w[1]) {
+				index = rp->blocks[i].to;
+			}
+		}
+		glUniformBlockBinding(map_name(rp->names, w[0]), index, w[2]);
+		break;
+	}
+	case CAPTURE_OP_BIND_BUFFER_RANGE:
+		glBindBufferRange(w[0], w[1], map_name(rp->buffers, w[2]), w[3], w[4]);
+		break;
+	case CAPTURE_OP_BIND_BUFFER_BASE:
+		glBindBufferBase(w[0], w[1], map_name(rp->buffers, w[2]));
+		break;
+	case CAPTURE_OP_TRANSFORM_FEEDBACK_VARYINGS: {
+		const GLchar *varyings[CAPTURE_MAX_VARYINGS];
+		const char *name = data;
+		GLsizei count = 0;
+		while (count < (GLsizei)w[1] && count < CAPTURE_MAX_VARYINGS) {
+			varyings[count++] = name;
+			name += strlen(name) + 1;
+		}
+		glTransformFeedbackVaryings(map_name(rp->names, w[0]), count, varyings, w[2]);
+		break;
+	}
+	case CAPTURE_OP_BEGIN_TRANSFORM_FEEDBACK:
+		glBeginTransformFeedback(w[0]);
+		break;
+	case CAPTURE_OP_END_TRANSFORM_FEEDBACK:
+		glEndTransformFeedback();
+		break;
+	case CAPTURE_OP_GEN_TEXTURES: {
+		const GLuint *names = data;
+		for (uint32_t i = 0; i < w[0]; ++i) {
+			GLuint texture;
+			glGenTextures(1, &texture);
+			set_name(rp->textures, names[i], texture);
+		}
+		break;
+	}
+	case CAPTURE_OP_DELETE_TEXTURES: {
+		const GLuint *names = data;
+		for (uint32_t i = 0; i < w[0]; ++i) {
+			GLuint texture = map_name(rp->textures, names[i]);
+			glDeleteTextures(1, &texture);
+			set_name(rp->textures, names[i], 0);
+		}
+		break;
+	}
+	case CAPTURE_OP_ACTIVE_TEXTURE:
+		glActiveTexture(w[0]);
+		break;
+	case CAPTURE_OP_BIND_TEXTURE:
+		glBindTexture(w[0], map_name(rp->textures, w[1]));
+		break;
+	case CAPTURE_OP_TEX_STORAGE_2D:
+		glTexStorage2D(w[0], w[1], w[2], w[3], w[4]);
+		break;
+	case CAPTURE_OP_TEX_PARAMETERI:
+		glTexParameteri(w[0], w[1], (GLint)w[2]);
+		break;
+	case CAPTURE_OP_GEN_FRAMEBUFFERS: {
+		const GLuint *names = data;
+		for (uint32_t i = 0; i < w[0]; ++i) {
+			GLuint framebuffer;
+			glGenFramebuffers(1, &framebuffer);
+			set_name(rp->framebuffers, names[i], framebuffer);
+		}
+		break;
+	}
+	case CAPTURE_OP_DELETE_FRAMEBUFFERS: {
+		const GLuint *names = data;
+		for (uint32_t i = 0; i < w[0]; ++i) {
+			GLuint framebuffer = map_name(rp->framebuffers, names[i]);
+			glDeleteFramebuffers(1, &framebuffer);
+			set_name(rp->framebuffers, names[i], 0);
+		}
+		break;
+	}
+	case CAPTURE_OP_BIND_FRAMEBUFFER:
+		/* 0 maps to 0: the window surface */
+		glBindFramebuffer(w[0], map_name(rp->framebuffers, w[1]));
+		break;
+	case CAPTURE_OP_FRAMEBUFFER_TEXTURE_2D:
+		glFramebufferTexture2D(w[0], w[1], w[2], map_name(rp->textures, w[3]), (GLint)w[4]);
+		break;
+	case CAPTURE_OP_BLIT_FRAMEBUFFER:
+		glBlitFramebuffer(w[0], w[1], w[2], w[3], w[4], w[5], w[6], w[7], w[8], w[9]);
+		break;
+	case CAPTURE_OP_DRAW_ARRAYS:
+		glDrawArrays(w[0], w[1], w[2]);
+		break;
+	case CAPTURE_OP_DRAW_ELEMENTS:
+		glDrawElements(w[0], w[1], w[2], w[3] ? data : (const void *)(uintptr_t)w[4]);
+		break;
+	case CAPTURE_OP_FLUSH:
+		glFlush();
+		break;
+	default:
+		break;
+	}
+	return op;
+}
+
+Eina_Bool replay_open(replay_s *rp, const char *path)
+{
+	memset(rp, 0, sizeof(*rp));
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "replay: cannot open %s", path);
+		return EINA_FALSE;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(capture_file_header_s)) {
+		close(fd);
+		return EINA_FALSE;
+	}
+	rp->map_size = st.st_size;
+	rp->map = mmap(NULL, rp->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (rp->map == MAP_FAILED) {
+		rp->map = NULL;
+		return EINA_FALSE;
+	}
+
+	const capture_file_header_s *header = (const capture_file_header_s *)rp->map;
+	if (header->magic != CAPTURE_MAGIC || header->version != CAPTURE_VERSION) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "replay: %s is not a capture version %d file", path, CAPTURE_VERSION);
+		replay_close(rp);
+		return EINA_FALSE;
+	}
+
+	/* Run setup up to the first frame */
+	rp->cursor = sizeof(*header);
+	while (rp->cursor + sizeof(capture_record_header_s) <= rp->map_size) {
+		const capture_record_header_s *record = (const capture_record_header_s *)(rp->map + rp->cursor);
+		if (record->op == CAPTURE_OP_FRAME_BEGIN || record->op == CAPTURE_OP_END) {
+			break;
+		}
+		execute_record(rp);
+	}
+	rp->setup_end = rp->cursor;
+	rp->min_ms = 1e9;
+	rp->active = EINA_TRUE;
+
+	dlog_print(DLOG_INFO, LOG_TAG, "replay: %s, %u frames", path, header->frames);
+	return EINA_TRUE;
+}
+
+static void report(replay_s *rp)
+{
+	dlog_print(DLOG_INFO, LOG_TAG, "replay: %d frames, avg %.3f ms, min %.3f ms, max %.3f ms",
+			rp->frames, rp->frames ? rp->total_ms / rp->frames : 0.0, rp->min_ms, rp->max_ms);
+	for (int op = 1; op < CAPTURE_OP_COUNT; ++op) {
+		if (rp->counts[op]) {
+			dlog_print(DLOG_INFO, LOG_TAG, "replay: %-30s %u", capture_op_name(op), rp->counts[op]);
+		}
+	}
+	memset(rp->counts, 0, sizeof(rp->counts));
+	rp->frames = 0;
+	rp->total_ms = rp->max_ms = 0.0;
+	rp->min_ms = 1e9;
+}
+
+void replay_frame(replay_s *rp)
+{
+	if (!rp->active) {
+		return;
+	}
+
+	double start = now_ms();
+	capture_op_e op = CAPTURE_OP_COUNT;
+	while (rp->cursor + sizeof(capture_record_header_s) <= rp->map_size) {
+		op = execute_record(rp);
+		if (op == CAPTURE_OP_FRAME_END || op == CAPTURE_OP_END) {
+			break;
+		}
+	}
+	/* Wait for the GPU so the timing covers the whole frame */
+	glFinish();
+	double elapsed = now_ms() - start;
+
+	if (op == CAPTURE_OP_FRAME_END) {
+		rp->frames++;
+		rp->total_ms += elapsed;
+		if (elapsed < rp->min_ms) {
+			rp->min_ms = elapsed;
+		}
+		if (elapsed > rp->max_ms) {
+			rp->max_ms = elapsed;
+		}
+	} else {
+		/* End of the capture: report this pass and loop over the frames again */
+		report(rp);
+		rp->cursor = rp->setup_end;
+	}
+}
+
+void replay_close(replay_s *rp)
+{
+	if (rp->active) {
+		for (int i = 0; i < CAPTURE_MAX_NAMES; ++i) {
+			if (rp->buffers[i]) {
+				glDeleteBuffers(1, &rp->buffers[i]);
+			}
+			if (rp->textures[i]) {
+				glDeleteTextures(1, &rp->textures[i]);
+			}
+			if (rp->framebuffers[i]) {
+				glDeleteFramebuffers(1, &rp->framebuffers[i]);
+			}
+			if (rp->names[i] && glIsProgram(rp->names[i])) {
+				glDeleteProgram(rp->names[i]);
+			} else if (rp->names[i] && glIsShader(rp->names[i])) {
+				glDeleteShader(rp->names[i]);
+			}
+		}
+	}
+	if (rp->map) {
+		munmap(rp->map, rp->map_size);
+	}
+	memset(rp, 0, sizeof(*rp));
+}
@@ -0,0 +1,275 @@
+/*
+ * rtpool.c
+ *
+ * Pool of offscreen render targets, see rtpool.h.
+ */
+
+#include "rtpool.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "openes_particalsystem.h"
+#include <Elementary_GL_Helpers.h>
+
+ELEMENTARY_GLVIEW_GLOBAL_DECLARE();
+
+/* RGBA8 color and 24-bit depth, padded to 32 bits by most drivers */
+#define TARGET_BYTES_PER_PIXEL 8
+#define SCENE_DEPTH_BYTES_PER_PIXEL 4
+
+static int bucket(int size)
+{
+	return (size + RTPOOL_BUCKET - 1) / RTPOOL_BUCKET * RTPOOL_BUCKET;
+}
+
+static void free_target(render_target_s *target)
+{
+	glDeleteFramebuffers(1, &target->fbo);
+	glDeleteTextures(1, &target->color);
+	glDeleteTextures(1, &target->depth);
+	glDeleteFramebuffers(1, &target->depth_fbo);
+	glDeleteTextures(1, &target->scene_depth);
+	memset(target, 0, sizeof(*target));
+}
+
+/*
+ * @brief gpumem_evict_cb of a target, registered under its color texture
+ */
+static void evict_target(void *data, GLuint name)
+{
+	rtpool_s *pool = data;
+	for (int i = 0; i < RTPOOL_MAX_TARGETS; ++i) {
+		if (pool->targets[i].fbo && pool->targets[i].color == name) {
+			free_target(&pool->targets[i]);
+		}
+	}
+}
+
+static GLuint create_texture(GLenum format, int width, int height, GLint filter)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return texture;
+}
+
+static size_t target_bytes(const rtpool_s *pool, int width, int height)
+{
+	size_t bytesPerPixel = TARGET_BYTES_PER_PIXEL + (pool->scene_depth ? SCENE_DEPTH_BYTES_PER_PIXEL : 0);
+	return (size_t)width * height * bytesPerPixel;
+}
+
+/*
+ * @brief Register <target> with the registry, evictable or pinned. Changing
+ *        an existing entry to evictable may evict it right away.
+ */
+static void track_target(rtpool_s *pool, render_target_s *target, Eina_Bool pinned)
+{
+	gpumem_track(pool->gpumem, GPUMEM_TEXTURE, target->color, target_bytes(pool, target->bucket_w, target->bucket_h),
+			"render target", pinned ? NULL : evict_target, pool);
+}
+
+static render_target_s *find_target(rtpool_s *pool, int bucketW, int bucketH)
+{
+	for (int i = 0; i < RTPOOL_MAX_TARGETS; ++i) {
+		render_target_s *candidate = &pool->targets[i];
+		if (candidate->fbo && candidate->bucket_w == bucketW && candidate->bucket_h == bucketH) {
+			return candidate;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * @brief A free slot, else the least recently used target other than the
+ *        current one
+ */
+static render_target_s *spare_slot(rtpool_s *pool)
+{
+	render_target_s *slot = NULL;
+	for (int i = 0; i < RTPOOL_MAX_TARGETS; ++i) {
+		render_target_s *candidate = &pool->targets[i];
+		if (candidate == pool->current) {
+			continue;
+		}
+		if (!slot || !candidate->fbo || (slot->fbo && candidate->last_use < slot->last_use)) {
+			slot = candidate;
+		}
+	}
+	return slot;
+}
+
+static void release_slot(rtpool_s *pool, render_target_s *slot)
+{
+	if (slot->fbo) {
+		gpumem_untrack(pool->gpumem, GPUMEM_TEXTURE, slot->color);
+		free_target(slot);
+	}
+}
+
+/*
+ * @brief Allocate a <width> x <height> target into <target>
+ * @param[in] pinned register it pinned, for the target about to be drawn to
+ * @return EINA_TRUE if the framebuffer is complete
+ */
+static Eina_Bool create_target(rtpool_s *pool, render_target_s *target, int width, int height, Eina_Bool pinned)
+{
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	target->color = create_texture(GL_RGBA8, width, height, GL_LINEAR);
+	target->depth = create_texture(GL_DEPTH_COMPONENT24, width, height, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &target->fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target->color, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, target->depth, 0);
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	if (pool->scene_depth && status == GL_FRAMEBUFFER_COMPLETE) {
+		/* Depth only: the pre-pass writes no color */
+		target->scene_depth = create_texture(GL_DEPTH_COMPONENT24, width, height, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glGenFramebuffers(1, &target->depth_fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, target->depth_fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, target->scene_depth, 0);
+		status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "rtpool: %dx%d target incomplete (0x%x)", width, height, status);
+		free_target(target);
+		return EINA_FALSE;
+	}
+	target->bucket_w = width;
+	target->bucket_h = height;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	pool->allocations++;
+	pool->allocation_ms += (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+	track_target(pool, target, pinned);
+	return target->fbo != 0;
+}
+
+void rtpool_init(rtpool_s *pool, gpumem_s *gpumem, Eina_Bool sceneDepth)
+{
+	memset(pool, 0, sizeof(*pool));
+	pool->gpumem = gpumem;
+	pool->scene_depth = sceneDepth;
+}
+
+render_target_s *rtpool_acquire(rtpool_s *pool, int width, int height)
+{
+	if (width <= 0 || height <= 0) {
+		return NULL;
+	}
+	int bucketW = bucket(width), bucketH = bucket(height);
+
+	render_target_s *target = find_target(pool, bucketW, bucketH);
+	if (target) {
+		pool->hits++;
+		if (target != pool->current) {
+			track_target(pool, target, EINA_TRUE);
+		}
+	} else {
+		target = spare_slot(pool);
+		release_slot(pool, target);
+		if (!create_target(pool, target, bucketW, bucketH, EINA_TRUE)) {
+			return NULL;
+		}
+	}
+
+	/* Only now may the previous target go, should the new one not fit beside it */
+	render_target_s *previous = pool->current;
+	pool->current = target;
+	if (previous != target) {
+		gpumem_reserve(pool->gpumem, target_bytes(pool, target->bucket_w, target->bucket_h));
+	}
+	if (previous && previous != target && previous->fbo) {
+		track_target(pool, previous, EINA_FALSE);
+	}
+
+	target->width = width;
+	target->height = height;
+	target->last_use = ++pool->clock;
+	gpumem_touch(pool->gpumem, GPUMEM_TEXTURE, target->color);
+	return target;
+}
+
+void rtpool_prewarm(rtpool_s *pool, int width, int height)
+{
+	if (!rtpool_acquire(pool, width, height) || width == height) {
+		return;
+	}
+
+	int bucketW = bucket(height), bucketH = bucket(width);
+	if (find_target(pool, bucketW, bucketH)) {
+		return;
+	}
+	render_target_s *slot = spare_slot(pool);
+	if (!slot) {
+		return;
+	}
+
+	/* Ahead of time only if it fits: evicting anything for it would defeat the point */
+	size_t freed = slot->fbo ? target_bytes(pool, slot->bucket_w, slot->bucket_h) : 0;
+	size_t bytes = target_bytes(pool, bucketW, bucketH);
+	if (pool->gpumem->total - freed + bytes > gpumem_limit(pool->gpumem)) {
+		dlog_print(DLOG_INFO, LOG_TAG, "rtpool: no room for a %dx%d target ahead of rotation (%zu bytes)",
+				bucketW, bucketH, bytes);
+		return;
+	}
+	release_slot(pool, slot);
+	create_target(pool, slot, bucketW, bucketH, EINA_FALSE);
+}
+
+void rtpool_bind(const render_target_s *target)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, target->fbo);
+	glViewport(0, 0, target->width, target->height);
+}
+
+void rtpool_bind_scene_depth(const render_target_s *target)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, target->depth_fbo);
+	glViewport(0, 0, target->width, target->height);
+}
+
+void rtpool_resolve_scene_depth(const render_target_s *target)
+{
+	/* Same size and format on both sides, so this is a plain copy */
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, target->depth_fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target->fbo);
+	glBlitFramebuffer(0, 0, target->width, target->height, 0, 0, target->width, target->height,
+			GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	rtpool_bind(target);
+}
+
+void rtpool_present(const render_target_s *target, int width, int height)
+{
+	/* Only color: the surface depth is not used after the scene */
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, target->fbo);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, target->width, target->height, 0, 0, width, height, GL_COLOR_BUFFER_BIT,
+			(target->width == width && target->height == height) ? GL_NEAREST : GL_LINEAR);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, width, height);
+}
+
+void rtpool_destroy(rtpool_s *pool)
+{
+	for (int i = 0; i < RTPOOL_MAX_TARGETS; ++i) {
+		release_slot(pool, &pool->targets[i]);
+	}
+	pool->current = NULL;
+	gpumem_reserve(pool->gpumem, 0);
+}
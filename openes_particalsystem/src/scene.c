@@ -0,0 +1,190 @@
+/*
+ * scene.c
+ *
+ * Opaque scene geometry, see scene.h.
+ */
+
+#include "scene.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "arena.h"
+#include "openes_particalsystem.h"
+#include <Elementary_GL_Helpers.h>
+
+ELEMENTARY_GLVIEW_GLOBAL_DECLARE();
+
+#define VERTEX_SIZE 6
+#define SPHERE_VERTICES ((SCENE_SPHERE_STACKS + 1) * (SCENE_SPHERE_SLICES + 1))
+#define SPHERE_INDICES (SCENE_SPHERE_STACKS * SCENE_SPHERE_SLICES * 6)
+/* A square clipped by one line has at most five corners */
+#define PLANE_VERTICES 5
+
+typedef struct {
+	float *vertices;
+	GLushort *indices;
+	int vertex_count;
+	int index_count;
+} mesh_s;
+
+static void add_vertex(mesh_s *mesh, const float position[3], const float normal[3])
+{
+	float *vertex = &mesh->vertices[mesh->vertex_count++ * VERTEX_SIZE];
+	memcpy(vertex, position, 3 * sizeof(float));
+	memcpy(vertex + 3, normal, 3 * sizeof(float));
+}
+
+static void add_sphere(mesh_s *mesh, const float center[3], float radius)
+{
+	int first = mesh->vertex_count;
+	for (int stack = 0; stack <= SCENE_SPHERE_STACKS; ++stack) {
+		float theta = (float)M_PI * stack / SCENE_SPHERE_STACKS;
+		for (int slice = 0; slice <= SCENE_SPHERE_SLICES; ++slice) {
+			float phi = 2.0f * (float)M_PI * slice / SCENE_SPHERE_SLICES;
+			float normal[3] = { sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi) };
+			float position[3] = {
+				center[0] + radius * normal[0],
+				center[1] + radius * normal[1],
+				center[2] + radius * normal[2],
+			};
+			add_vertex(mesh, position, normal);
+		}
+	}
+	for (int stack = 0; stack < SCENE_SPHERE_STACKS; ++stack) {
+		for (int slice = 0; slice < SCENE_SPHERE_SLICES; ++slice) {
+			GLushort a = first + stack * (SCENE_SPHERE_SLICES + 1) + slice;
+			GLushort b = a + SCENE_SPHERE_SLICES + 1;
+			GLushort *index = &mesh->indices[mesh->index_count];
+			index[0] = a; index[1] = b; index[2] = a + 1;
+			index[3] = a + 1; index[4] = b; index[5] = b + 1;
+			mesh->index_count += 6;
+		}
+	}
+}
+
+/*
+ * @brief The part of the near face inside the half-space dot(p, n) < d,
+ *        as a triangle fan
+ */
+static void add_plane(mesh_s *mesh, const float n[3], float d)
+{
+	static const float corners[4][2] = { { -1.0f, -1.0f }, { 1.0f, -1.0f }, { 1.0f, 1.0f }, { -1.0f, 1.0f } };
+	static const float normal[3] = { 0.0f, 0.0f, -1.0f };
+
+	/* Clip the face with the plane, one edge at a time */
+	float polygon[PLANE_VERTICES][2];
+	int count = 0;
+	for (int i = 0; i < 4; ++i) {
+		const float *a = corners[i], *b = corners[(i + 1) % 4];
+		float da = d - (n[0] * a[0] + n[1] * a[1] - n[2]);
+		float db = d - (n[0] * b[0] + n[1] * b[1] - n[2]);
+		if (da > 0.0f) {
+			polygon[count][0] = a[0];
+			polygon[count][1] = a[1];
+			count++;
+		}
+		if ((da > 0.0f) != (db > 0.0f)) {
+			float t = da / (da - db);
+			polygon[count][0] = a[0] + t * (b[0] - a[0]);
+			polygon[count][1] = a[1] + t * (b[1] - a[1]);
+			count++;
+		}
+	}
+	if (count < 3) {
+		return;
+	}
+
+	int first = mesh->vertex_count;
+	for (int i = 0; i < count; ++i) {
+		float position[3] = { polygon[i][0], polygon[i][1], -1.0f };
+		add_vertex(mesh, position, normal);
+	}
+	for (int i = 1; i + 1 < count; ++i) {
+		GLushort *index = &mesh->indices[mesh->index_count];
+		index[0] = first; index[1] = first + i; index[2] = first + i + 1;
+		mesh->index_count += 3;
+	}
+}
+
+Eina_Bool scene_init(scene_s *scene, const particle_force_s *forces, int count, gpumem_s *gpumem)
+{
+	memset(scene, 0, sizeof(*scene));
+	if (count <= 0) {
+		return EINA_TRUE;
+	}
+
+	mesh_s mesh = { 0 };
+	mesh.vertices = heap_alloc(count * SPHERE_VERTICES * VERTEX_SIZE * sizeof(float));
+	mesh.indices = heap_alloc(count * SPHERE_INDICES * sizeof(GLushort));
+	if (!mesh.vertices || !mesh.indices) {
+		heap_free(mesh.vertices);
+		heap_free(mesh.indices);
+		return EINA_FALSE;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		const particle_force_s *force = &forces[i];
+		switch ((int)force->params[0]) {
+		case PARTICLE_COLLIDER_PLANE:
+			add_plane(&mesh, force->vector, force->vector[3]);
+			break;
+		case PARTICLE_COLLIDER_SPHERE:
+			add_sphere(&mesh, force->vector, force->vector[3]);
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (mesh.index_count) {
+		size_t vertexBytes = mesh.vertex_count * VERTEX_SIZE * sizeof(float);
+		size_t indexBytes = mesh.index_count * sizeof(GLushort);
+		glGenBuffers(1, &scene->vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, scene->vbo);
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, mesh.vertices, GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glGenBuffers(1, &scene->ibo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene->ibo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, mesh.indices, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		gpumem_track(gpumem, GPUMEM_BUFFER, scene->vbo, vertexBytes, "scene vertices", NULL, NULL);
+		gpumem_track(gpumem, GPUMEM_BUFFER, scene->ibo, indexBytes, "scene indices", NULL, NULL);
+		scene->index_count = mesh.index_count;
+	}
+	dlog_print(DLOG_INFO, LOG_TAG, "scene: %d vertices, %d triangles", mesh.vertex_count, mesh.index_count / 3);
+
+	heap_free(mesh.vertices);
+	heap_free(mesh.indices);
+	return EINA_TRUE;
+}
+
+void scene_draw(const scene_s *scene)
+{
+	if (!scene->index_count) {
+		return;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, scene->vbo);
+	glVertexAttribPointer(SCENE_POSITION_ATTRIB, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE * sizeof(GLfloat), (const void *)0);
+	glVertexAttribPointer(SCENE_NORMAL_ATTRIB, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE * sizeof(GLfloat),
+			(const void *)(3 * sizeof(GLfloat)));
+	glEnableVertexAttribArray(SCENE_POSITION_ATTRIB);
+	glEnableVertexAttribArray(SCENE_NORMAL_ATTRIB);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene->ibo);
+	glDrawElements(GL_TRIANGLES, scene->index_count, GL_UNSIGNED_SHORT, (const void *)0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glDisableVertexAttribArray(SCENE_POSITION_ATTRIB);
+	glDisableVertexAttribArray(SCENE_NORMAL_ATTRIB);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void scene_destroy(scene_s *scene, gpumem_s *gpumem)
+{
+	if (scene->vbo) {
+		gpumem_untrack(gpumem, GPUMEM_BUFFER, scene->vbo);
+		gpumem_untrack(gpumem, GPUMEM_BUFFER, scene->ibo);
+		glDeleteBuffers(1, &scene->vbo);
+		glDeleteBuffers(1, &scene->ibo);
+	}
+	memset(scene, 0, sizeof(*scene));
+}
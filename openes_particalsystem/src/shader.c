@@ -0,0 +1,125 @@
+/*
+ * shader.c
+ *
+ * Shader compilation helpers shared by the render and simulation passes.
+ */
+
+#include "shader.h"
+
+#include <dlog.h>
+
+#include "openes_particalsystem.h"
+#include <Elementary_GL_Helpers.h>
+
+ELEMENTARY_GLVIEW_GLOBAL_DECLARE();
+
+/*
+ * @brief Log the info log of a failed shader or program build
+ * @param[in] object shader or program object
+ * @param[in] infoLen length of the info log, terminator included
+ */
+static void LogInfo(arena_s *scratch, GLuint object, GLint infoLen, Eina_Bool isProgram, const char *what)
+{
+	size_t mark = arena_mark(scratch);
+	char *infoLog = arena_alloc(scratch, infoLen);
+	if (!infoLog) {
+		dlog_print(DLOG_ERROR, LOG_TAG, "Error %s (%d byte log does not fit the scratch arena)\n", what, infoLen);
+		return;
+	}
+	if (isProgram) {
+		glGetProgramInfoLog(object, infoLen, NULL, infoLog);
+	} else {
+		glGetShaderInfoLog(object, infoLen, NULL, infoLog);
+	}
+	dlog_print(DLOG_ERROR, LOG_TAG, "Error %s:\n%s\n", what, infoLog);
+	arena_release(scratch, mark);
+}
+
+static GLuint LoadShader(arena_s *scratch, GLenum type, const char *shaderSrc)
+{
+	GLuint shader;
+	GLint compiled;
+	// Create the shader object
+	shader = glCreateShader(type);
+	if (shader == 0) {
+		return 0;
+	}
+	// Load the shader source
+	glShaderSource(shader, 1, &shaderSrc, NULL);
+	// Compile the shader
+	glCompileShader(shader);
+	// Check the compile status
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+	if (!compiled) {
+		GLint infoLen = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
+		if (infoLen > 1) {
+			LogInfo(scratch, shader, infoLen, EINA_FALSE, "compiling shader");
+		}
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+/*
+ * @brief create sharder program
+ * @param[in] varyings transform feedback outputs captured interleaved, or NULL
+ * @param[in] varyingCount number of <varyings>
+ */
+GLuint CreateFeedbackProgram(arena_s *scratch, const char *vertexShaderSrc, const char *fragmentShaderSrc,
+		const char * const *varyings, int varyingCount)
+{
+	/* Load the vertex/fragment shaders */
+	GLuint vertexShader = LoadShader(scratch, GL_VERTEX_SHADER, vertexShaderSrc);
+	if (vertexShader == 0) {
+		return 0;
+	}
+	GLuint fragmentShader = LoadShader(scratch, GL_FRAGMENT_SHADER, fragmentShaderSrc);
+	if (fragmentShader == 0) {
+		return 0;
+	}
+	/* Create the program object */
+	GLuint program = glCreateProgram();
+	if (program == 0) {
+		return 0;
+	}
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	if (varyings) {
+		glTransformFeedbackVaryings(program, varyingCount, varyings, GL_INTERLEAVED_ATTRIBS);
+	}
+
+	// Link the program
+	glLinkProgram(program);
+	// Check the link status
+	GLint linked;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		GLint infoLen = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLen);
+		if (infoLen > 1) {
+			LogInfo(scratch, program, infoLen, EINA_TRUE, "linking program");
+		}
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+	return program;
+}
+
+GLuint CreateProgram(arena_s *scratch, const char *vertexShaderSrc, const char *fragmentShaderSrc)
+{
+	return CreateFeedbackProgram(scratch, vertexShaderSrc, fragmentShaderSrc, NULL, 0);
+}
+
+void BindUniformBlock(GLuint program, const char *name, GLuint binding)
+{
+	/* Blocks the compiler found unused have no index */
+	GLuint index = glGetUniformBlockIndex(program, name);
+	if (index != GL_INVALID_INDEX) {
+		glUniformBlockBinding(program, index, binding);
+	}
+}
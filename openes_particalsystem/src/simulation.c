@@ -0,0 +1,502 @@
+/*
+ * simulation.c
+ *
+ * Particle simulation stage, see simulation.h.
+ */
+
+#include "openes_particalsystem.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "cmdlist.h"
+#include <Elementary_GL_Helpers.h>
+
+ELEMENTARY_GLVIEW_GLOBAL_DECLARE();
+
+#define STATE_STRIDE (PARTICLE_STATE_SIZE * sizeof(GLfloat))
+#define EMITTER_STATE_BYTES (NUM_PARTICLES * STATE_STRIDE)
+
+/*
+ * GPU version of particles_simulate(). Force types are the values of
+ * particle_force_type_e; keep both implementations in step. Each type is
+ * compiled in only when its macro is defined, see update_features.
+ */
+static const char uShaderStr[] =
+		"#version 300 es\n"
+		"#if defined(FORCE_GRAVITY) || defined(FORCE_DRAG) || defined(FORCE_ATTRACTOR) || defined(FORCE_TURBULENCE)\n"
+		"#define HAS_FORCES\n"
+		"#endif\n"
+		"#if defined(COLLIDER_PLANE) || defined(COLLIDER_SPHERE)\n"
+		"#define HAS_COLLIDERS\n"
+		"#endif\n"
+		FRAME_PARAMS_BLOCK
+		EMITTER_PARAMS_BLOCK
+		FORCE_PARAMS_BLOCK
+		"layout(location = 1) in vec3 a_startPosition;\n"
+		"layout(location = 2) in vec3 a_endPosition;\n"
+		"layout(location = 3) in vec3 a_position;\n"
+		"layout(location = 4) in vec3 a_velocity;\n"
+		"out vec3 v_position;\n"
+		"out vec3 v_velocity;\n"
+		"#ifdef FORCE_TURBULENCE\n"
+		"vec3 curlNoise(vec3 p, float f, float phase)\n"
+		"{\n"
+		"  vec3 sa = sin(f * p + phase), ca = cos(f * p + phase);\n"
+		"  vec3 sb = sin(f * p + phase * 1.3), cb = cos(f * p + phase * 1.3);\n"
+		"  return f * vec3(-sa.x * sb.y - ca.z * cb.x,\n"
+		"                  -sa.y * sb.z - ca.x * cb.y,\n"
+		"                  -sa.z * sb.x - ca.y * cb.z);\n"
+		"}\n"
+		"#endif\n"
+		"#ifdef HAS_COLLIDERS\n"
+		"void contact(inout vec3 pos, inout vec3 vel, vec3 n, float depth, float restitution, float friction)\n"
+		"{\n"
+		"  pos += n * depth;\n"
+		"  float vn = dot(vel, n);\n"
+		"  if (vn < 0.0) {\n"
+		"    vel = (vel - vn * n) * (1.0 - friction) - n * vn * restitution;\n"
+		"  }\n"
+		"}\n"
+		"#endif\n"
+		"void main()\n"
+		"{\n"
+		"  vec3 pos = a_position;\n"
+		"  vec3 vel = a_velocity;\n"
+		"  if (u_burst > 0.5) {\n"
+		"    pos = a_startPosition + u_centerPosition.xyz;\n"
+		"    vel = a_endPosition;\n"
+		"  } else {\n"
+		"    vec3 acc = vec3(0.0);\n"
+		"#ifdef HAS_FORCES\n"
+		"    for (int i = 0; i < u_forceCount.x; ++i) {\n"
+		"      vec4 p = u_forces[i].params;\n"
+		"      vec4 v = u_forces[i].vector;\n"
+		"      int type = int(p.x);\n"
+		"#ifdef FORCE_GRAVITY\n"
+		"      if (type == 0)\n"
+		"        acc += v.xyz * p.y;\n"
+		"#endif\n"
+		"#ifdef FORCE_DRAG\n"
+		"      if (type == 1)\n"
+		"        acc -= vel * p.y;\n"
+		"#endif\n"
+		"#ifdef FORCE_ATTRACTOR\n"
+		"      if (type == 2) {\n"
+		"        vec3 d = v.xyz - pos;\n"
+		"        float r2 = dot(d, d) + p.z * p.z;\n"
+		"        acc += d * (p.y / (r2 * sqrt(r2)));\n"
+		"      }\n"
+		"#endif\n"
+		"#ifdef FORCE_TURBULENCE\n"
+		"      if (type == 3)\n"
+		"        acc += curlNoise(pos, p.z, u_frameTime * p.w) * p.y;\n"
+		"#endif\n"
+		"    }\n"
+		"#endif\n"
+		"    vel += acc * u_timeStep;\n"
+		"    pos += vel * u_timeStep;\n"
+		"#ifdef HAS_COLLIDERS\n"
+		"    for (int i = 0; i < u_forceCount.x; ++i) {\n"
+		"      vec4 p = u_forces[i].params;\n"
+		"      vec4 v = u_forces[i].vector;\n"
+		"      int type = int(p.x);\n"
+		"#ifdef COLLIDER_PLANE\n"
+		"      if (type == 4) {\n"
+		"        float depth = v.w - dot(pos, v.xyz);\n"
+		"        if (depth > 0.0)\n"
+		"          contact(pos, vel, v.xyz, depth, p.z, p.w);\n"
+		"      }\n"
+		"#endif\n"
+		"#ifdef COLLIDER_SPHERE\n"
+		"      if (type == 5) {\n"
+		"        vec3 d = pos - v.xyz;\n"
+		"        float dist = length(d);\n"
+		"        if (dist < v.w && dist > 0.0)\n"
+		"          contact(pos, vel, d / dist, v.w - dist, p.z, p.w);\n"
+		"      }\n"
+		"#endif\n"
+		"    }\n"
+		"#endif\n"
+		"  }\n"
+		"  v_position = pos;\n"
+		"  v_velocity = vel;\n"
+		"  gl_Position = vec4(pos, 1.0);\n"
+		"}";
+
+/* Never rasterized, but ES 3.0 needs a fragment shader to link */
+static const char uFragShaderStr[] =
+		"#version 300 es\n"
+		"precision mediump float;\n"
+		"out vec4 fragColor;\n"
+		"void main()\n"
+		"{\n"
+		"  fragColor = vec4(0.0);\n"
+		"}";
+
+/* Macros of the force types, in particle_force_type_e order */
+static const char * const update_features[PARTICLE_FORCE_TYPE_COUNT] = {
+	"FORCE_GRAVITY", "FORCE_DRAG", "FORCE_ATTRACTOR", "FORCE_TURBULENCE", "COLLIDER_PLANE", "COLLIDER_SPHERE",
+};
+
+static const char * const update_varyings[] = { "v_position", "v_velocity" };
+
+static const variant_block_s update_blocks[] = {
+	{ "FrameParams", FRAME_PARAMS_BINDING },
+	{ "EmitterParams", EMITTER_PARAMS_BINDING },
+	{ "ForceParams", FORCE_PARAMS_BINDING },
+};
+
+static const variant_family_s update_family = {
+	.label = "feedback program",
+	.vertex = uShaderStr,
+	.fragment = uFragShaderStr,
+	.features = update_features,
+	.feature_count = PARTICLE_FORCE_TYPE_COUNT,
+	.varyings = update_varyings,
+	.varying_count = sizeof(update_varyings) / sizeof(update_varyings[0]),
+	.blocks = update_blocks,
+	.block_count = sizeof(update_blocks) / sizeof(update_blocks[0]),
+};
+
+/*
+ * @brief Update program variant for the force list: a feature per force
+ *        type in use
+ */
+static GLuint update_program(const simulation_s *sim, struct appdata *ad)
+{
+	variant_features_t features = 0;
+	for (int f = 0; f < sim->force_count; ++f) {
+		int type = (int)sim->forces[f].params[0];
+		if (type >= 0 && type < PARTICLE_FORCE_TYPE_COUNT) {
+			features |= 1u << type;
+		}
+	}
+	return variants_get(&ad->shaders, &update_family, features);
+}
+
+Eina_Bool simulation_init(simulation_s *sim, struct appdata *ad, const float *restore)
+{
+#ifdef PARTICLE_SIM_CPU
+	sim->path = SIM_PATH_CPU;
+#else
+	sim->path = SIM_PATH_GPU;
+#endif
+	sim->src = 0;
+	sim->stats_frames = 0;
+	memset(sim->stats, 0, sizeof(sim->stats));
+
+	if (sim->path == SIM_PATH_GPU) {
+		/* Built now for the initial force list, other lists build on first use */
+		if (update_program(sim, ad) == 0) {
+			return EINA_FALSE;
+		}
+	}
+
+	if (restore) {
+		memcpy(sim->state, restore, sizeof(sim->state));
+	} else {
+		for (int i = 0; i < NUM_EMITTERS; ++i) {
+			particles_reset_state(ad->particleData, &sim->state[i * NUM_PARTICLES * PARTICLE_STATE_SIZE],
+					NUM_PARTICLES, ad->emitters[i].center);
+		}
+	}
+
+	/* The CPU path rewrites one buffer, the GPU path ping-pongs between two */
+	int buffers = (sim->path == SIM_PATH_GPU) ? 2 : 1;
+	glGenBuffers(buffers, sim->state_vbo);
+	for (int i = 0; i < buffers; ++i) {
+		glBindBuffer(GL_ARRAY_BUFFER, sim->state_vbo[i]);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(sim->state), restore ? restore : sim->state,
+				sim->path == SIM_PATH_GPU ? GL_DYNAMIC_COPY : GL_STREAM_DRAW);
+		gpumem_track(&ad->gpumem, GPUMEM_BUFFER, sim->state_vbo[i], sizeof(sim->state), "particle state", NULL, NULL);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	sim->readback_vbo = 0;
+	sim->readback_fence = 0;
+	if (sim->path == SIM_PATH_GPU) {
+		glGenBuffers(1, &sim->readback_vbo);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, sim->readback_vbo);
+		glBufferData(GL_COPY_WRITE_BUFFER, sizeof(sim->state), NULL, GL_STREAM_READ);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		gpumem_track(&ad->gpumem, GPUMEM_BUFFER, sim->readback_vbo, sizeof(sim->state), "state readback", NULL, NULL);
+	}
+	return EINA_TRUE;
+}
+
+int simulation_add_force(simulation_s *sim, const particle_force_s *force)
+{
+	if (sim->force_count >= PARTICLE_MAX_FORCES) {
+		return -1;
+	}
+	sim->forces[sim->force_count] = *force;
+	return sim->force_count++;
+}
+
+void simulation_write_forces(const simulation_s *sim, force_params_s *params)
+{
+	params->count[0] = sim->force_count;
+	params->count[1] = params->count[2] = params->count[3] = 0;
+	memcpy(params->forces, sim->forces, sim->force_count * sizeof(particle_force_s));
+}
+
+/*
+ * One chunk of SIM_JOB_PARTICLES particles of one emitter
+ */
+typedef struct {
+	const simulation_s *sim;
+	const float *data;		// particle data of the first particle
+	float *state;			// state of the first particle
+	int count;
+	const emitter_s *emitter;
+	float dt, time;
+	float *accel;
+	particle_force_stats_s stats[PARTICLE_MAX_FORCES];
+	cmdlist_s *commands;		// upload of the chunk, or NULL
+	GLintptr offset;		// of the chunk in the state buffer
+} sim_job_s;
+
+static void simulate_chunk(void *data, int thread)
+{
+	sim_job_s *job = data;
+
+	if (job->emitter->burst) {
+		particles_reset_state(job->data, job->state, job->count, job->emitter->center);
+	} else {
+		particles_simulate(job->state, job->count, job->sim->forces, job->sim->force_count,
+				job->dt, job->time, job->accel, job->stats);
+	}
+	if (job->commands) {
+		cmdlist_buffer_sub_data(job->commands, GL_ARRAY_BUFFER, job->sim->state_vbo[0], job->offset,
+				job->count * STATE_STRIDE, job->state);
+	}
+}
+
+/*
+ * @brief Run the reference simulation of every emitter on sim->state,
+ *        SIM_JOB_PARTICLES particles per job
+ * @param[in] stats per force cost counters, or NULL
+ * @param[in] upload EINA_TRUE to copy the new state into the state buffer
+ */
+static void simulate_cpu(simulation_s *sim, struct appdata *ad, float dt, particle_force_stats_s *stats,
+		Eina_Bool upload)
+{
+	enum { CHUNKS = (NUM_PARTICLES + SIM_JOB_PARTICLES - 1) / SIM_JOB_PARTICLES, JOBS = NUM_EMITTERS * CHUNKS };
+
+	/* Everything the jobs touch comes from the frame arena, allocated up front */
+	job_s *jobs = arena_alloc(&ad->frame_arena, JOBS * sizeof(job_s));
+	sim_job_s *work = arena_alloc(&ad->frame_arena, JOBS * sizeof(sim_job_s));
+	cmdlist_s *lists = arena_alloc(&ad->frame_arena, JOBS * sizeof(cmdlist_s));
+	cmd_s *commands = arena_alloc(&ad->frame_arena, JOBS * sizeof(cmd_s));
+	float *accel = arena_alloc(&ad->frame_arena, NUM_EMITTERS * NUM_PARTICLES * 3 * sizeof(float));
+	if (!jobs || !work || !lists || !commands || !accel) {
+		return;
+	}
+
+	job_counter_s counter;
+	atomic_init(&counter.pending, 0);
+	for (int j = 0; j < JOBS; ++j) {
+		int emitter = j / CHUNKS;
+		int first = (j % CHUNKS) * SIM_JOB_PARTICLES;
+		int index = emitter * NUM_PARTICLES + first;
+		sim_job_s *job = &work[j];
+
+		job->sim = sim;
+		job->data = &ad->particleData[first * PARTICLE_SIZE];
+		job->state = &sim->state[index * PARTICLE_STATE_SIZE];
+		job->count = (first + SIM_JOB_PARTICLES <= NUM_PARTICLES) ? SIM_JOB_PARTICLES : NUM_PARTICLES - first;
+		job->emitter = &ad->emitters[emitter];
+		job->dt = dt;
+		job->time = ad->time;
+		job->accel = &accel[index * 3];
+		memset(job->stats, 0, sizeof(job->stats));
+		job->offset = index * STATE_STRIDE;
+		job->commands = upload ? &lists[j] : NULL;
+		cmdlist_init(&lists[j], &commands[j], 1);
+
+		jobs[j].func = simulate_chunk;
+		jobs[j].data = job;
+		jobs_submit(&ad->jobs, &jobs[j], &counter);
+	}
+	jobs_wait(&ad->jobs, &counter);
+
+	if (stats) {
+		for (int j = 0; j < JOBS; ++j) {
+			for (int f = 0; f < sim->force_count; ++f) {
+				stats[f].evaluations += work[j].stats[f].evaluations;
+				stats[f].ns += work[j].stats[f].ns;
+			}
+		}
+	}
+	if (upload) {
+		cmdlist_submit(lists, JOBS);
+	}
+}
+
+static void simulate_gpu(simulation_s *sim, struct appdata *ad, const GLintptr *emitterOffsets)
+{
+	GLuint program = update_program(sim, ad);
+	if (program == 0) {
+		return;
+	}
+	GLuint src = sim->state_vbo[sim->src];
+	GLuint dst = sim->state_vbo[sim->src ^ 1];
+
+	glUseProgram(program);
+	glEnable(GL_RASTERIZER_DISCARD);
+
+	glBindBuffer(GL_ARRAY_BUFFER, ad->vbo);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, PARTICLE_SIZE * sizeof(GLfloat), (const void *)(1 * sizeof(GLfloat)));
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, PARTICLE_SIZE * sizeof(GLfloat), (const void *)(4 * sizeof(GLfloat)));
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glEnableVertexAttribArray(3);
+	glEnableVertexAttribArray(4);
+
+	for (int i = 0; i < NUM_EMITTERS; ++i) {
+		GLintptr offset = i * EMITTER_STATE_BYTES;
+		glBindBuffer(GL_ARRAY_BUFFER, src);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, STATE_STRIDE, (const void *)offset);
+		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, STATE_STRIDE, (const void *)(offset + 3 * sizeof(GLfloat)));
+		ubo_ring_bind(&ad->ubo, EMITTER_PARAMS_BINDING, emitterOffsets[i], sizeof(emitter_params_s));
+		glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, dst, offset, EMITTER_STATE_BYTES);
+
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, NUM_PARTICLES);
+		glEndTransformFeedback();
+	}
+
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDisableVertexAttribArray(4);
+	glDisable(GL_RASTERIZER_DISCARD);
+	sim->src ^= 1;
+}
+
+#ifdef PARTICLE_SIM_VALIDATE
+/*
+ * @brief Log the largest difference between the GPU state and the reference
+ */
+static void validate(simulation_s *sim)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, sim->state_vbo[sim->src]);
+	const float *gpu = glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(sim->state), GL_MAP_READ_BIT);
+	if (gpu) {
+		float maxError = 0.0f;
+		for (size_t i = 0; i < sizeof(sim->state) / sizeof(float); ++i) {
+			float error = fabsf(gpu[i] - sim->state[i]);
+			if (error > maxError) {
+				maxError = error;
+			}
+		}
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		dlog_print(DLOG_INFO, LOG_TAG, "simulation: max GPU/CPU state difference %f", maxError);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+#endif
+
+/*
+ * @brief Log and reset the per force cost counters
+ */
+static void report_stats(simulation_s *sim)
+{
+	for (int f = 0; f < sim->force_count; ++f) {
+		particle_force_stats_s *stats = &sim->stats[f];
+		const char *name = particle_force_name((int)sim->forces[f].params[0]);
+		if (sim->path == SIM_PATH_CPU && stats->evaluations) {
+			dlog_print(DLOG_INFO, LOG_TAG, "simulation: force %d %-10s %llu evaluations, %.2f ns each", f, name,
+					(unsigned long long)stats->evaluations, (double)stats->ns / stats->evaluations);
+		} else {
+			dlog_print(DLOG_INFO, LOG_TAG, "simulation: force %d %-10s %llu evaluations on the GPU", f, name,
+					(unsigned long long)stats->evaluations);
+		}
+	}
+	memset(sim->stats, 0, sizeof(sim->stats));
+	sim->stats_frames = 0;
+}
+
+void simulation_update(simulation_s *sim, struct appdata *ad, const GLintptr *emitterOffsets, float dt)
+{
+	if (sim->path == SIM_PATH_CPU) {
+		simulate_cpu(sim, ad, dt, sim->stats, EINA_TRUE);
+	} else {
+		simulate_gpu(sim, ad, emitterOffsets);
+		/* GPU cost is not measurable per force, count the work instead */
+		for (int f = 0; f < sim->force_count; ++f) {
+			sim->stats[f].evaluations += NUM_EMITTERS * NUM_PARTICLES;
+		}
+#ifdef PARTICLE_SIM_VALIDATE
+		simulate_cpu(sim, ad, dt, NULL, EINA_FALSE);
+		if (ad->frame % SIM_VALIDATE_FRAMES == 0) {
+			validate(sim);
+		}
+#endif
+	}
+
+	if (++sim->stats_frames >= SIM_STATS_FRAMES) {
+		report_stats(sim);
+	}
+}
+
+Eina_Bool simulation_readback_begin(simulation_s *sim)
+{
+	if (sim->path != SIM_PATH_GPU || sim->readback_fence) {
+		return EINA_FALSE;
+	}
+	/* Copied on the GPU; the fence tells when mapping will not stall */
+	glBindBuffer(GL_COPY_READ_BUFFER, sim->state_vbo[sim->src]);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, sim->readback_vbo);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(sim->state));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	sim->readback_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	return sim->readback_fence != 0;
+}
+
+Eina_Bool simulation_readback_poll(simulation_s *sim, float *state)
+{
+	if (!sim->readback_fence) {
+		return EINA_FALSE;
+	}
+	GLenum status = glClientWaitSync(sim->readback_fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		return EINA_FALSE;
+	}
+	glDeleteSync(sim->readback_fence);
+	sim->readback_fence = 0;
+	if (status == GL_WAIT_FAILED) {
+		return EINA_FALSE;
+	}
+
+	glBindBuffer(GL_COPY_READ_BUFFER, sim->readback_vbo);
+	const float *mapped = glMapBufferRange(GL_COPY_READ_BUFFER, 0, sizeof(sim->state), GL_MAP_READ_BIT);
+	if (mapped) {
+		memcpy(state, mapped, sizeof(sim->state));
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	return mapped != NULL;
+}
+
+GLuint simulation_state_buffer(const simulation_s *sim)
+{
+	return sim->state_vbo[sim->src];
+}
+
+void simulation_destroy(simulation_s *sim, struct appdata *ad)
+{
+	for (int i = 0; i < 2; ++i) {
+		gpumem_untrack(&ad->gpumem, GPUMEM_BUFFER, sim->state_vbo[i]);
+	}
+	gpumem_untrack(&ad->gpumem, GPUMEM_BUFFER, sim->readback_vbo);
+	if (sim->readback_fence) {
+		glDeleteSync(sim->readback_fence);
+		sim->readback_fence = 0;
+	}
+	glDeleteBuffers(1, &sim->readback_vbo);
+	sim->readback_vbo = 0;
+	glDeleteBuffers(sim->path == SIM_PATH_GPU ? 2 : 1, sim->state_vbo);
+	sim->state_vbo[0] = sim->state_vbo[1] = 0;
+}
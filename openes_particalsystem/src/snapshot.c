@@ -0,0 +1,185 @@
+/*
+ * snapshot.c
+ *
+ * Particle state snapshots, see snapshot.h.
+ */
+
+#include "snapshot.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+
+static uint64_t align16(uint64_t offset)
+{
+	return (offset + 15) & ~(uint64_t)15;
+}
+
+size_t snapshot_layout(snapshot_header_s *header, int particleCount, int emitterCount, int particleSize, int stateSize)
+{
+	header->magic = SNAPSHOT_MAGIC;
+	header->version = SNAPSHOT_VERSION;
+	header->header_size = sizeof(*header);
+	header->particle_count = particleCount;
+	header->emitter_count = emitterCount;
+	header->particle_size = particleSize;
+	header->state_size = stateSize;
+
+	header->data_offset = align16(sizeof(*header));
+	header->state_offset = align16(header->data_offset + (uint64_t)particleCount * particleSize * sizeof(float));
+	header->emitters_offset = align16(header->state_offset +
+			(uint64_t)emitterCount * particleCount * stateSize * sizeof(float));
+	header->file_size = header->emitters_offset + (uint64_t)emitterCount * sizeof(snapshot_emitter_s);
+	return header->file_size;
+}
+
+int snapshot_writer_init(snapshot_writer_s *writer, size_t capacity)
+{
+	memset(writer, 0, sizeof(*writer));
+	writer->buffer = heap_alloc(capacity);
+	if (!writer->buffer) {
+		return -1;
+	}
+	/* Alignment padding is never written to, keep it deterministic */
+	memset(writer->buffer, 0, capacity);
+	writer->capacity = capacity;
+	return 0;
+}
+
+static int write_file(const char *path, const void *buffer, size_t size)
+{
+	char temporary[PATH_MAX + 8];
+	int result = -1;
+
+	/* Write aside, sync and rename, so a kill never leaves a torn snapshot behind */
+	snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+	int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		return -1;
+	}
+	const char *bytes = buffer;
+	size_t written = 0;
+	while (written < size) {
+		ssize_t n = write(fd, bytes + written, size - written);
+		if (n <= 0) {
+			break;
+		}
+		written += n;
+	}
+	if (written == size && fsync(fd) == 0) {
+		result = 0;
+	}
+	if (close(fd) != 0) {
+		result = -1;
+	}
+	if (result == 0 && rename(temporary, path) != 0) {
+		result = -1;
+	}
+	if (result != 0) {
+		unlink(temporary);
+	}
+	return result;
+}
+
+static void *writer_thread(void *data)
+{
+	snapshot_writer_s *writer = data;
+	writer->result = write_file(writer->path, writer->buffer, writer->size);
+	return NULL;
+}
+
+int snapshot_writer_join(snapshot_writer_s *writer)
+{
+	if (writer->busy) {
+		pthread_join(writer->thread, NULL);
+		writer->busy = 0;
+	}
+	return writer->result;
+}
+
+void *snapshot_writer_begin(snapshot_writer_s *writer)
+{
+	snapshot_writer_join(writer);
+	return writer->buffer;
+}
+
+int snapshot_write_async(snapshot_writer_s *writer, const char *path, size_t size)
+{
+	snapshot_writer_join(writer);
+	if (size > writer->capacity) {
+		return -1;
+	}
+	snprintf(writer->path, sizeof(writer->path), "%s", path);
+	writer->size = size;
+	writer->result = -1;
+
+	if (pthread_create(&writer->thread, NULL, writer_thread, writer) == 0) {
+		writer->busy = 1;
+		return 0;
+	}
+	writer->result = write_file(writer->path, writer->buffer, writer->size);
+	return writer->result;
+}
+
+void snapshot_writer_destroy(snapshot_writer_s *writer)
+{
+	snapshot_writer_join(writer);
+	heap_free(writer->buffer);
+	memset(writer, 0, sizeof(*writer));
+}
+
+int snapshot_map(snapshot_s *snapshot, const char *path)
+{
+	struct stat st;
+
+	memset(snapshot, 0, sizeof(*snapshot));
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return -1;
+	}
+	void *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(snapshot_header_s)) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) {
+		return -1;
+	}
+	snapshot->map = map;
+	snapshot->size = st.st_size;
+
+	/* The header must describe exactly this file */
+	const snapshot_header_s *header = map;
+	snapshot_header_s expected;
+	if (header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION ||
+			header->header_size != sizeof(*header) ||
+			snapshot_layout(&expected, header->particle_count, header->emitter_count,
+					header->particle_size, header->state_size) != snapshot->size ||
+			header->file_size != expected.file_size ||
+			header->data_offset != expected.data_offset ||
+			header->state_offset != expected.state_offset ||
+			header->emitters_offset != expected.emitters_offset) {
+		snapshot_unmap(snapshot);
+		return -1;
+	}
+
+	const char *base = map;
+	snapshot->header = header;
+	snapshot->data = (const float *)(base + header->data_offset);
+	snapshot->state = (const float *)(base + header->state_offset);
+	snapshot->emitters = (const snapshot_emitter_s *)(base + header->emitters_offset);
+	return 0;
+}
+
+void snapshot_unmap(snapshot_s *snapshot)
+{
+	if (snapshot->map) {
+		munmap(snapshot->map, snapshot->size);
+	}
+	memset(snapshot, 0, sizeof(*snapshot));
+}
@@ -0,0 +1,116 @@
+/*
+ * ubo.c
+ *
+ * Ring buffered uniform buffer object, see ubo.h.
+ */
+
+#include "ubo.h"
+
+#include <string.h>
+#include <dlog.h>
+
+#include "openes_particalsystem.h"
+#include <Elementary_GL_Helpers.h>
+
+ELEMENTARY_GLVIEW_GLOBAL_DECLARE();
+
+Eina_Bool ubo_ring_init(ubo_ring_s *ring, int blocks, GLsizeiptr block_size)
+{
+	memset(ring, 0, sizeof(*ring));
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ring->alignment);
+	if (ring->alignment <= 0) {
+		ring->alignment = 256;
+	}
+	ring->slice_size = blocks * ubo_ring_block_size(ring, block_size);
+
+	glGenBuffers(1, &ring->buffer);
+	if (ring->buffer == 0) {
+		return EINA_FALSE;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+	glBufferData(GL_UNIFORM_BUFFER, ring->slice_size * UBO_RING_SLICES, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	ring->slice = UBO_RING_SLICES - 1;
+	return EINA_TRUE;
+}
+
+GLsizeiptr ubo_ring_block_size(const ubo_ring_s *ring, GLsizeiptr size)
+{
+	return (size + ring->alignment - 1) / ring->alignment * ring->alignment;
+}
+
+Eina_Bool ubo_ring_begin(ubo_ring_s *ring)
+{
+	ring->slice = (ring->slice + 1) % UBO_RING_SLICES;
+	ring->offset = 0;
+
+	/* Normally signalled long ago; only blocks if the GPU is a full ring behind */
+	GLsync fence = ring->fences[ring->slice];
+	if (fence) {
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fence);
+		ring->fences[ring->slice] = NULL;
+	}
+
+	/* Unsynchronized: the fence above already guarantees the slice is idle */
+	glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+	ring->mapped = glMapBufferRange(GL_UNIFORM_BUFFER, ring->slice * ring->slice_size, ring->slice_size,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!ring->mapped) {
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		dlog_print(DLOG_ERROR, LOG_TAG, "ubo: cannot map slice %d", ring->slice);
+		return EINA_FALSE;
+	}
+	return EINA_TRUE;
+}
+
+void *ubo_ring_alloc(ubo_ring_s *ring, GLsizeiptr size, GLintptr *offset)
+{
+	GLsizeiptr block = ubo_ring_block_size(ring, size);
+
+	if (!ring->mapped || ring->offset + block > ring->slice_size) {
+		return NULL;
+	}
+	void *ptr = ring->mapped + ring->offset;
+	*offset = ring->slice * ring->slice_size + ring->offset;
+	ring->offset += block;
+	return ptr;
+}
+
+void ubo_ring_end(ubo_ring_s *ring)
+{
+	if (!ring->mapped) {
+		return;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, ring->buffer);
+	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	ring->mapped = NULL;
+}
+
+void ubo_ring_bind(ubo_ring_s *ring, GLuint binding, GLintptr offset, GLsizeiptr size)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, ring->buffer, offset, size);
+}
+
+void ubo_ring_fence(ubo_ring_s *ring)
+{
+	if (ring->fences[ring->slice]) {
+		glDeleteSync(ring->fences[ring->slice]);
+	}
+	ring->fences[ring->slice] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void ubo_ring_destroy(ubo_ring_s *ring)
+{
+	for (int i = 0; i < UBO_RING_SLICES; ++i) {
+		if (ring->fences[i]) {
+			glDeleteSync(ring->fences[i]);
+		}
+	}
+	if (ring->buffer) {
+		glDeleteBuffers(1, &ring->buffer);
+	}
+	memset(ring, 0, sizeof(*ring));
+}
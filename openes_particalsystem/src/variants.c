@@ -0,0 +1,220 @@
+/*
+ * variants.c
+ *
+ * Shader variants built from feature bits, see variants.h.
+ */
+
+#include "variants.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "openes_particalsystem.h"
+#include "shader.h"
+#include <Elementary_GL_Helpers.h>
+
+ELEMENTARY_GLVIEW_GLOBAL_DECLARE();
+
+#define DEFINE_PREFIX "#define "
+#define DEFINE_SUFFIX " 1\n"
+
+/*
+ * @brief Feature names of a variant for logs, "-" without features
+ */
+static const char *describe(const variant_family_s *family, variant_features_t features, char *text, size_t size)
+{
+	size_t length = 0;
+	text[0] = '\0';
+	for (int i = 0; i < family->feature_count; ++i) {
+		if (features & (1u << i)) {
+			int n = snprintf(text + length, size - length, "%s%s", length ? "|" : "", family->features[i]);
+			if (n < 0 || (size_t)n >= size - length) {
+				break;
+			}
+			length += n;
+		}
+	}
+	return length ? text : "-";
+}
+
+/*
+ * @brief Copy of <source> with a #define per feature after its #version line
+ * @return source in the scratch arena, NULL if it does not fit
+ */
+static char *specialize(arena_s *scratch, const variant_family_s *family, variant_features_t features,
+		const char *source)
+{
+	const char *body = strchr(source, '\n');
+	body = body ? body + 1 : source + strlen(source);
+
+	size_t size = strlen(source) + 1;
+	for (int i = 0; i < family->feature_count; ++i) {
+		if (features & (1u << i)) {
+			size += strlen(DEFINE_PREFIX) + strlen(family->features[i]) + strlen(DEFINE_SUFFIX);
+		}
+	}
+	char *text = arena_alloc(scratch, size);
+	if (!text) {
+		return NULL;
+	}
+
+	char *out = text;
+	memcpy(out, source, body - source);
+	out += body - source;
+	for (int i = 0; i < family->feature_count; ++i) {
+		if (features & (1u << i)) {
+			out += sprintf(out, DEFINE_PREFIX "%s" DEFINE_SUFFIX, family->features[i]);
+		}
+	}
+	strcpy(out, body);
+	return text;
+}
+
+static variant_s *find(variants_s *variants, GLuint program)
+{
+	for (int i = 0; i < VARIANTS_MAX; ++i) {
+		if (variants->variants[i].family && variants->variants[i].program == program) {
+			return &variants->variants[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * @brief gpumem_evict_cb of a variant
+ */
+static void evict_variant(void *data, GLuint program)
+{
+	variant_s *variant = find(data, program);
+	glDeleteProgram(program);
+	if (variant) {
+		memset(variant, 0, sizeof(*variant));
+	}
+}
+
+static void free_variant(variants_s *variants, variant_s *variant)
+{
+	if (variant->program) {
+		gpumem_untrack(variants->gpumem, GPUMEM_PROGRAM, variant->program);
+		glDeleteProgram(variant->program);
+	}
+	memset(variant, 0, sizeof(*variant));
+}
+
+/*
+ * @brief Build <features> of <family> into <variant>
+ */
+static void compile(variants_s *variants, variant_s *variant, const variant_family_s *family,
+		variant_features_t features)
+{
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	variant->family = family;
+	variant->features = features;
+	variant->program = 0;
+	variant->last_use = ++variants->clock;
+
+	size_t mark = arena_mark(variants->scratch);
+	char *vertex = specialize(variants->scratch, family, features, family->vertex);
+	char *fragment = specialize(variants->scratch, family, features, family->fragment);
+	if (vertex && fragment) {
+		variant->program = CreateFeedbackProgram(variants->scratch, vertex, fragment,
+				family->varyings, family->varying_count);
+	}
+	arena_release(variants->scratch, mark);
+
+	char text[128];
+	if (variant->program == 0) {
+		/* Kept as a failed slot, so a broken variant is not rebuilt every frame */
+		variants->failed++;
+		dlog_print(DLOG_ERROR, LOG_TAG, "variants: %s [%s] does not build", family->label,
+				describe(family, features, text, sizeof(text)));
+		return;
+	}
+
+	for (int i = 0; i < family->block_count; ++i) {
+		BindUniformBlock(variant->program, family->blocks[i].name, family->blocks[i].binding);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+	variants->compiled++;
+	variants->compile_ms += ms;
+	dlog_print(DLOG_INFO, LOG_TAG, "variants: built %s [%s] in %.2f ms", family->label,
+			describe(family, features, text, sizeof(text)), ms);
+
+	GLint length = 0;
+	glGetProgramiv(variant->program, GL_PROGRAM_BINARY_LENGTH, &length);
+	gpumem_track(variants->gpumem, GPUMEM_PROGRAM, variant->program, length > 0 ? length : 0, family->label,
+			evict_variant, variants);
+}
+
+void variants_init(variants_s *variants, arena_s *scratch, gpumem_s *gpumem)
+{
+	memset(variants, 0, sizeof(*variants));
+	variants->scratch = scratch;
+	variants->gpumem = gpumem;
+}
+
+GLuint variants_get(variants_s *variants, const variant_family_s *family, variant_features_t features)
+{
+	variant_s *slot = NULL;
+	for (int i = 0; i < VARIANTS_MAX; ++i) {
+		variant_s *variant = &variants->variants[i];
+		if (variant->family == family && variant->features == features) {
+			variant->last_use = ++variants->clock;
+			if (variant->program) {
+				variants->hits++;
+				gpumem_touch(variants->gpumem, GPUMEM_PROGRAM, variant->program);
+			}
+			return variant->program;
+		}
+		/* A free slot, else the least recently used variant */
+		if (!slot || !variant->family || (slot->family && variant->last_use < slot->last_use)) {
+			slot = variant;
+		}
+	}
+
+	if (slot->family) {
+		free_variant(variants, slot);
+	}
+	/* Tracked as used now, so the next gpumem_apply() cannot evict it */
+	compile(variants, slot, family, features);
+	return slot->program;
+}
+
+int variants_prewarm(variants_s *variants, const variant_family_s *family, const variant_features_t *set, int count)
+{
+	int built = 0;
+	for (int i = 0; i < count; ++i) {
+		if (variants_get(variants, family, set[i])) {
+			built++;
+		}
+	}
+	return built;
+}
+
+void variants_report(variants_s *variants)
+{
+	int cached = 0;
+	for (int i = 0; i < VARIANTS_MAX; ++i) {
+		if (variants->variants[i].program) {
+			cached++;
+		}
+	}
+	dlog_print(DLOG_INFO, LOG_TAG, "variants: %d cached, %d built in %.2f ms, %d failed, %d hits",
+			cached, variants->compiled, variants->compile_ms, variants->failed, variants->hits);
+	variants->compiled = 0;
+	variants->failed = 0;
+	variants->hits = 0;
+	variants->compile_ms = 0.0;
+}
+
+void variants_destroy(variants_s *variants)
+{
+	for (int i = 0; i < VARIANTS_MAX; ++i) {
+		free_variant(variants, &variants->variants[i]);
+	}
+}